@@ -133,25 +133,49 @@ static void process(scm *s, scm *t)
     const int c = scm_get_c(s);
 
     long long b = 0;
+    long long l = 0;
+    long long i;
+    scm_iter *r;
     float    *p;
     float    *q;
 
-    if (scm_scan_catalog(s))
+    // Catalog any pages already bordered by a resumed run, to skip them and
+    // link new pages after the last.
+
+    if (scm_scan_catalog(t))
+        for (l = scm_get_length(t), i = 0; i < l; ++i)
+            if (b < scm_get_offset(t, i))
+                b = scm_get_offset(t, i);
+
+    // Pages may be bordered in any order, so read them in file order.
+
+    if (scm_scan_catalog(s) && (r = scm_iter_open(s, SCM_ORDER_FILE,
+                                                     SCM_READ_AHEAD)))
     {
         if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(t)))
         {
-            for (long long i = 0; i < scm_get_length(s); ++i)
+            while (scm_iter_next(r, &i))
             {
+                if (l && scm_search(t, scm_get_index(s, i)) >= 0)
+                    continue;
+
                 if (scm_read_page(s, scm_get_offset(s, i), p))
                 {
                     // Determine the page indices of all neighboring pages.
 
                     long long x   = scm_get_index(s, i);
+                    long long v[8];
 
-                    long long xn  = scm_page_north(x);
-                    long long xs  = scm_page_south(x);
-                    long long xw  = scm_page_west (x);
-                    long long xe  = scm_page_east (x);
+                    scm_page_neighbors(x, v);
+
+                    long long xn  = v[0];
+                    long long xs  = v[1];
+                    long long xw  = v[2];
+                    long long xe  = v[3];
+                    long long xnw = v[4];
+                    long long xne = v[5];
+                    long long xsw = v[6];
+                    long long xse = v[7];
 
                     // Determine their roots.
 
@@ -161,17 +185,6 @@ static void process(scm *s, scm *t)
                     long long fw  = scm_page_root(xw);
                     long long fe  = scm_page_root(xe);
 
-                    // Use roots to guide the determination of diagonals.
-
-                    long long xnw = (fn == f) ? scm_page_west (xn)
-                                              : scm_page_north(xw);
-                    long long xne = (fn == f) ? scm_page_east (xn)
-                                              : scm_page_north(xe);
-                    long long xsw = (fs == f) ? scm_page_west (xs)
-                                              : scm_page_south(xw);
-                    long long xse = (fs == f) ? scm_page_east (xs)
-                                              : scm_page_south(xe);
-
                     // Seek the page catalog locations of all neighbors.
 
                     long long in  = scm_search(s, xn);
@@ -229,12 +242,13 @@ static void process(scm *s, scm *t)
             free(q);
             free(p);
         }
+        scm_iter_close(r);
     }
 }
 
 //------------------------------------------------------------------------------
 
-int border(int argc, char **argv, const char *o)
+int border(int argc, char **argv, const char *o, int u)
 {
     if (argc > 0)
     {
@@ -250,7 +264,8 @@ int border(int argc, char **argv, const char *o)
             int b = scm_get_b(s);
             int g = scm_get_g(s);
 
-            if ((t = scm_ofile(out, n, c, b, g)))
+            if ((t = u ? scm_rfile(out, n, c, b, g)
+                       : scm_ofile(out, n, c, b, g)))
             {
                 process(s, t);
                 scm_close(t);
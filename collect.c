@@ -0,0 +1,89 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scm.h"
+#include "err.h"
+#include "util.h"
+#include "process.h"
+
+//------------------------------------------------------------------------------
+
+// Write a collection manifest listing all SCM TIFFs given as input. Confirm
+// that each input opens and that all inputs share the same page parameters.
+// Shard names are resolved relative to the directory of the manifest, so any
+// leading manifest directory is removed from the given names.
+
+int collect(int argc, char **argv, const char *o)
+{
+    const char *out = o ? o : "out.scm";
+
+    char  dir[256];
+    FILE *fp;
+
+    int n = 0;
+    int c = 0;
+    int b = 0;
+    int g = 0;
+
+    dircpy(dir, out);
+
+    for (int i = 0; i < argc; i++)
+    {
+        scm *s;
+
+        if ((s = scm_ifile(argv[i])))
+        {
+            if (i && (n != scm_get_n(s) || c != scm_get_c(s) ||
+                      b != scm_get_b(s) || g != scm_get_g(s)))
+            {
+                apperr("SCM TIFF '%s' has size %d chan %d depth %d sign %d."
+                       " Expected size %d chan %d depth %d sign %d.",
+                       argv[i], scm_get_n(s), scm_get_c(s),
+                                scm_get_b(s), scm_get_g(s), n, c, b, g);
+                scm_close(s);
+                return -1;
+            }
+
+            n = scm_get_n(s);
+            c = scm_get_c(s);
+            b = scm_get_b(s);
+            g = scm_get_g(s);
+
+            scm_close(s);
+        }
+        else return -1;
+    }
+
+    if ((fp = fopen(out, "w")))
+    {
+        const size_t l = strlen(dir);
+
+        fprintf(fp, "%s\n", SCM_MANIFEST);
+
+        for (int i = 0; i < argc; i++)
+            if (argv[i][0] != '/' && strncmp(argv[i], dir, l) == 0)
+                fprintf(fp, "%s\n", argv[i] + l);
+            else
+                fprintf(fp, "%s\n", argv[i]);
+
+        fclose(fp);
+    }
+    else syserr("Failed to open %s", out);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
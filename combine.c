@@ -21,34 +21,6 @@
 
 //------------------------------------------------------------------------------
 
-static inline float sum(float a, float b)
-{
-    return a + b;
-}
-
-static inline float avg(float a, float b)
-{
-    if (a == 0.f) return b;
-    if (b == 0.f) return a;
-    return (a + b) * 0.5f;
-}
-
-static inline void blend(float *dst, const float *src, int c)
-{
-    const float a =       src[c - 1];
-    const float b = 1.f - src[c - 1];
-
-    switch (c)
-    {
-        case 4: dst[2] = dst[2] * b + src[2] * a;
-        case 3: dst[1] = dst[1] * b + src[1] * a;
-        case 2: dst[0] = dst[0] * b + src[0] * a;
-    }
-    dst[c - 1] = max(dst[c - 1], src[c - 1]);
-}
-
-//------------------------------------------------------------------------------
-
 // Attempt to read and map the SCM TIFF with the given name. If successful,
 // append it to the given list. Return the number of elements in the list.
 
@@ -146,26 +118,7 @@ static void process(scm *s, scm **V, int C, int O)
 
                 for (int f = 0; f < C; ++f)
                     if (o[f] && scm_read_page(V[f], o[f], q))
-
-                        switch (O)
-                        {
-                            case 0:
-                                for (size_t j = 0; j < S; ++j)
-                                    p[j] = sum(p[j], q[j]);
-                                break;
-                            case 1:
-                                for (size_t j = 0; j < S; ++j)
-                                    p[j] = max(p[j], q[j]);
-                                break;
-                            case 2:
-                                for (size_t j = 0; j < S; ++j)
-                                    p[j] = avg(p[j], q[j]);
-                                break;
-                            case 3:
-                                for (size_t j = 0; j < S; j += c)
-                                    blend(p + j, q + j, c);
-                                break;
-                        }
+                        combine_page(p, q, c, scm_get_n(s), O);
 
                 b = scm_append(s, b, x, p);
             }
@@ -187,12 +140,7 @@ int combine(int argc, char **argv, const char *o, const char *m)
     const char *out = o ? o : "out.tif";
 
     if (m)
-    {
-        if      (strcmp(m, "sum")   == 0) O = 0;
-        else if (strcmp(m, "max")   == 0) O = 1;
-        else if (strcmp(m, "avg")   == 0) O = 2;
-        else if (strcmp(m, "blend") == 0) O = 3;
-    }
+        O = combine_mode(m);
 
     if ((V = (scm **) calloc((size_t) argc, sizeof (scm *))))
     {
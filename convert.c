@@ -15,9 +15,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
 #include <math.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "scm.h"
 #include "scmdef.h"
 #include "img.h"
@@ -25,6 +33,10 @@
 #include "util.h"
 #include "process.h"
 
+#ifdef _WIN32
+#define stat _stat64
+#endif
+
 //------------------------------------------------------------------------------
 
 #define NTAPS 1024
@@ -43,12 +55,207 @@ static void init_tap(int a, int d, int n, int *x)
     }
 }
 
+// Compare the latitude range a0 through a1 and longitude range b0 through b1
+// with those of the image extent E. Longitude ranges wrap. Return -1 if the
+// ranges, shrunk by k, are disjoint. Return +1 if the ranges, grown by k, lie
+// within the extent. Return 0 otherwise.
+
+static int extent_compare(const double *E, double a0, double a1,
+                                           double b0, double b1, double k)
+{
+    const double T = 2.0 * M_PI;
+    const double W = E[3] - E[2];
+
+    double d;
+    double e;
+
+    // Test for disjoint ranges.
+
+    if (a1 - k < E[0] || E[1] < a0 + k)
+        return -1;
+
+    if (b1 - b0 < T && W < T)
+    {
+        d = fmod(fmod(E[2] - (b0 + k), T) + T, T);
+        e = fmod(fmod((b0 + k) - E[2], T) + T, T);
+
+        if (d > (b1 - b0) - 2 * k && e > W)
+            return -1;
+    }
+
+    // Test for contained ranges.
+
+    if (E[0] < a0 - k && a1 + k < E[1])
+    {
+        if (W >= T)
+            return +1;
+
+        e = fmod(fmod((b0 - k) - E[2], T) + T, T);
+
+        if (b1 - b0 < T && e + (b1 - b0) + 2 * k < W)
+            return +1;
+    }
+    return 0;
+}
+
+static inline double dot3(const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void cross3(double *c, const double *a, const double *b)
+{
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Find the latitude range a0 through a1 and longitude range b0 through b1 of
+// the page at row u column v of the w-by-w page array on face f. The page is
+// bounded by great circle arcs, along which longitude is monotonic, so its
+// longitude range is that of its corners unless it contains a pole. Its
+// latitude range is that of its corners and the highest and lowest point of
+// each edge.
+
+static void page_range(int f, long u, long v, long w, double *A0, double *A1,
+                                                      double *B0, double *B1)
+{
+    static const int R[4] = { 0, 1, 3, 2 };
+
+    const double Y[3] = { 0.0, 1.0, 0.0 };
+
+    double c[12];
+    double n[12];
+    double a0 =  M_PI / 2.0;
+    double a1 = -M_PI / 2.0;
+    int    s0 = 0;
+    int    s1 = 0;
+
+    scm_get_sample_corners(f, u, v, w, c);
+
+    for (int i = 0; i < 4; i++)
+    {
+        const double *p = c + 3 * R[i];
+        const double *q = c + 3 * R[(i + 1) % 4];
+
+        double t[3];
+        double g[3];
+        double h[3];
+
+        a0 = min(a0, asin(p[1]));
+        a1 = max(a1, asin(p[1]));
+
+        // Find the point of the edge's great circle nearest the north pole,
+        // and include it, or its antipode, where it falls on the edge.
+
+        cross3(n + 3 * i, p, q);
+
+        const double *m = n + 3 * i;
+        const double  z = dot3(m, m);
+
+        t[0] =     - m[0] * m[1] / z;
+        t[1] = 1.0 - m[1] * m[1] / z;
+        t[2] =     - m[2] * m[1] / z;
+
+        if (dot3(t, t) > 0.0)
+        {
+            normalize(t);
+
+            cross3(g, p, t);
+            cross3(h, t, q);
+
+            if (dot3(g, m) >= 0.0 && dot3(h, m) >= 0.0)
+                a1 = max(a1, asin(min(1.0, t[1])));
+
+            t[0] = -t[0];
+            t[1] = -t[1];
+            t[2] = -t[2];
+
+            cross3(g, p, t);
+            cross3(h, t, q);
+
+            if (dot3(g, m) >= 0.0 && dot3(h, m) >= 0.0)
+                a0 = min(a0, asin(max(-1.0, t[1])));
+        }
+
+        if (dot3(m, Y) >= 0.0) s0++;
+        if (dot3(m, Y) <= 0.0) s1++;
+    }
+
+    // A page containing a pole spans all longitudes.
+
+    if (s0 == 4 || s1 == 4)
+    {
+        const double k = (dot3(c, Y) > 0.0) ? 1.0 : -1.0;
+
+        if (k > 0.0) a1 =  M_PI / 2.0;
+        else         a0 = -M_PI / 2.0;
+
+        *B0 = 0.0;
+        *B1 = 2.0 * M_PI;
+    }
+    else
+    {
+        const double l = atan2(c[0], c[2]);
+
+        double b0 = 0.0;
+        double b1 = 0.0;
+
+        for (int i = 1; i < 4; i++)
+        {
+            double d = atan2(c[i * 3 + 0], c[i * 3 + 2]) - l;
+
+            if (d >  M_PI) d -= 2.0 * M_PI;
+            if (d < -M_PI) d += 2.0 * M_PI;
+
+            b0 = min(b0, d);
+            b1 = max(b1, d);
+        }
+        *B0 = l + b0;
+        *B1 = l + b1;
+    }
+    *A0 = a0;
+    *A1 = a1;
+}
+
+// Compare the page at row u column v of the w-by-w page array on face f with
+// image extent E, as above.
+
+static int page_compare(const double *E, int f, long u, long v, long w)
+{
+    double a0;
+    double a1;
+    double b0;
+    double b1;
+
+    page_range(f, u, v, w, &a0, &a1, &b0, &b1);
+
+    return extent_compare(E, a0, a1, b0, b1, 1e-12);
+}
+
 // Determine whether the image intersects with the page at row u column v of the
-// w-by-w page array on face f. This function is inefficient and only works
-// under limited circumstances.
+// w-by-w page array on face f. Where the image gives its extent, reject pages
+// outside of it and accept pages inside of it analytically. Where the extent is
+// only a bound, accept internal pages d > 0 conservatively. Otherwise probe the
+// page, which is inefficient and only works under limited circumstances.
 
-static bool overlap(img *p, int f, long u, long v, long w)
+static bool overlap(img *p, int f, long u, long v, long w, int d)
 {
+    double E[4];
+    int    e;
+
+    if ((e = img_extent(p, E)))
+    {
+        const int k = page_compare(E, f, u, v, w);
+
+        if (k < 0)
+            return false;
+        if (k > 0 && e == 2)
+            return true;
+        if (d > 0 && e == 1)
+            return true;
+    }
+
     for (int t = 0; t < MTAPS; ++t)
     {
         int i = tap[t] / NTAPS;
@@ -64,281 +271,1160 @@ static bool overlap(img *p, int f, long u, long v, long w)
     return false;
 }
 
+// A region of interest limits the output to pages that intersect a box of
+// latitude and longitude, a polygon with vertices given in latitude and
+// longitude, or both. Box and polygon bounds are in extent order, in radians.
+
+typedef struct
+{
+    double  E[4];
+    double  P[4];
+    double *v;
+    int     n;
+} region;
+
+static region G;
+
+// Set the region of interest to box B, given in degrees as for the -E option,
+// and the polygon listed in the named file as latitude-longitude pairs. A box
+// with west above east wraps eastward past 180. Polygon longitudes must be
+// continuous, so an edge crossing 180 runs from 170 to 190, not to -170.
+
+static bool region_init(const double *B, const char *name)
+{
+    double  a;
+    double  b;
+    double *v;
+    FILE   *fp;
+
+    free(G.v);
+    memset(&G, 0, sizeof (region));
+
+    if (B[0] || B[1] || B[2] || B[3])
+    {
+        G.E[0] = B[2] * M_PI / 180.0;
+        G.E[1] = B[3] * M_PI / 180.0;
+        G.E[2] = B[0] * M_PI / 180.0;
+        G.E[3] = B[1] * M_PI / 180.0;
+
+        if (G.E[2] > G.E[3])
+            G.E[3] += 2.0 * M_PI;
+    }
+
+    if (name)
+    {
+        if ((fp = fopen(name, "r")))
+        {
+            while (fscanf(fp, "%lf %lf", &a, &b) == 2)
+                if ((v = (double *) realloc(G.v, (size_t) (G.n + 1) * 2
+                                                     * sizeof (double))))
+                {
+                    G.v = v;
+                    G.v[G.n * 2 + 0] = a * M_PI / 180.0;
+                    G.v[G.n * 2 + 1] = b * M_PI / 180.0;
+                    G.n++;
+                }
+            fclose(fp);
+        }
+        else
+        {
+            syserr("Failed to open %s", name);
+            return false;
+        }
+
+        if (G.n < 3)
+        {
+            apperr("%s: Region needs at least three vertices", name);
+            return false;
+        }
+
+        G.P[0] = G.P[1] = G.v[0];
+        G.P[2] = G.P[3] = G.v[1];
+
+        for (int i = 1; i < G.n; i++)
+        {
+            G.P[0] = min(G.P[0], G.v[i * 2 + 0]);
+            G.P[1] = max(G.P[1], G.v[i * 2 + 0]);
+            G.P[2] = min(G.P[2], G.v[i * 2 + 1]);
+            G.P[3] = max(G.P[3], G.v[i * 2 + 1]);
+        }
+    }
+    return true;
+}
+
+// Determine whether the point p of latitude and longitude falls within the
+// region polygon, counting the edges crossed by a ray of constant latitude.
+
+static bool region_contains(const double *p)
+{
+    bool c = false;
+
+    for (int i = 0, j = G.n - 1; i < G.n; j = i++)
+    {
+        const double *q = G.v + i * 2;
+        const double *r = G.v + j * 2;
+
+        if ((q[0] > p[0]) != (r[0] > p[0]) &&
+            p[1] < q[1] + (p[0] - q[0]) * (r[1] - q[1]) / (r[0] - q[0]))
+            c = !c;
+    }
+    return c;
+}
+
+static double orient(const double *p, const double *q, const double *r)
+{
+    return (q[0] - p[0]) * (r[1] - p[1]) - (q[1] - p[1]) * (r[0] - p[0]);
+}
+
+// Determine whether the region polygon intersects the latitude range a0 through
+// a1 and longitude range b0 through b1. The ranges bound a page, so the test is
+// conservative. Longitudes are taken in the turn nearest the polygon.
+
+static bool region_polygon(double a0, double a1, double b0, double b1)
+{
+    const double T = 2.0 * M_PI;
+    const double k = T * floor(((b0 + b1) - (G.P[2] + G.P[3])) / (2.0 * T) + 0.5);
+
+    const double c[4][2] = {
+        { a0, b0 - k }, { a0, b1 - k }, { a1, b1 - k }, { a1, b0 - k }
+    };
+
+    // Test for a vertex of either within the other.
+
+    for (int i = 0; i < G.n; i++)
+        if (a0     <= G.v[i * 2 + 0] && G.v[i * 2 + 0] <= a1 &&
+            b0 - k <= G.v[i * 2 + 1] && G.v[i * 2 + 1] <= b1 - k)
+            return true;
+
+    for (int i = 0; i < 4; i++)
+        if (region_contains(c[i]))
+            return true;
+
+    // Test for crossing edges.
+
+    for (int i = 0, j = G.n - 1; i < G.n; j = i++)
+        for (int l = 0; l < 4; l++)
+        {
+            const double *p = G.v + i * 2;
+            const double *q = G.v + j * 2;
+            const double *r = c[l];
+            const double *s = c[(l + 1) % 4];
+
+            if ((orient(r, s, p) > 0.0) != (orient(r, s, q) > 0.0) &&
+                (orient(p, q, r) > 0.0) != (orient(p, q, s) > 0.0))
+                return true;
+        }
+
+    return false;
+}
+
+// Determine whether the page at row u column v of the w-by-w page array on face
+// f intersects the region of interest, if any.
+
+static bool region_overlap(int f, long u, long v, long w)
+{
+    const bool e = (G.E[0] || G.E[1] || G.E[2] || G.E[3]);
+
+    double a0;
+    double a1;
+    double b0;
+    double b1;
+
+    if (e || G.n)
+    {
+        page_range(f, u, v, w, &a0, &a1, &b0, &b1);
+
+        if (e && extent_compare(G.E, a0, a1, b0, b1, 1e-12) < 0)
+            return false;
+        if (G.n && extent_compare(G.P, a0, a1, b0, b1, 1e-12) < 0)
+            return false;
+        if (G.n && !region_polygon(a0, a1, b0, b1))
+            return false;
+    }
+    return true;
+}
+
+// A sampling kernel gives the position of each of its taps within a pixel, as
+// bilinear weights of the pixel's four corner vectors and as a fractional row
+// and column, and the filter weight of each tap. The default quincunx kernel
+// generates its taps by successive midpoints instead. Radius r gives the tap
+// spacing in pixel widths.
+
+#define KTAPS 64
+
+typedef struct
+{
+    int    n;
+    int    q;
+    double r;
+    double c[KTAPS][4];
+    double o[KTAPS][2];
+    float  w[KTAPS];
+    float  W;
+} kernel;
+
+static kernel K;
+
+// Add a tap at row s column t of the unit pixel with filter weight w.
+
+static void kernel_tap(double s, double t, float w)
+{
+    if (K.n < KTAPS)
+    {
+        K.c[K.n][0] = (1.0 - s) * (1.0 - t);
+        K.c[K.n][1] = (      s) * (1.0 - t);
+        K.c[K.n][2] = (1.0 - s) * (      t);
+        K.c[K.n][3] = (      s) * (      t);
+        K.o[K.n][0] = s;
+        K.o[K.n][1] = t;
+        K.w[K.n]    = w;
+        K.W        += w;
+        K.n        += 1;
+    }
+}
+
+// Initialize the sampling kernel given by S: 1 for a single central tap, 5 for
+// the default quincunx, NxN for an N-by-N stratified pattern with tent weights,
+// or a list of s,t,w triples giving the row, column, and weight of each tap.
+
+static bool kernel_init(const char *S)
+{
+    double s;
+    double t;
+    double w;
+    int    n;
+    int    k;
+
+    memset(&K, 0, sizeof (kernel));
+
+    if (S == NULL || strcmp(S, "5") == 0)
+    {
+        kernel_tap(0.25, 0.25, 1.f);
+        kernel_tap(0.75, 0.25, 1.f);
+        kernel_tap(0.25, 0.75, 1.f);
+        kernel_tap(0.75, 0.75, 1.f);
+        kernel_tap(0.50, 0.50, 1.f);
+
+        K.q = 1;
+        K.r = 0.5;
+    }
+    else if (strcmp(S, "1") == 0)
+    {
+        kernel_tap(0.5, 0.5, 1.f);
+        K.r = 1.0;
+    }
+    else if (sscanf(S, "%dx%d", &n, &k) == 2 && n == k && 1 < n && n * n <= KTAPS)
+    {
+        for     (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+            {
+                s = (i + 0.5) / n;
+                t = (j + 0.5) / n;
+                kernel_tap(s, t, (float) ((1.0 - fabs(s - 0.5)) *
+                                          (1.0 - fabs(t - 0.5))));
+            }
+
+        K.r = 1.0 / n;
+    }
+    else
+    {
+        for (const char *c = S; c && sscanf(c, "%lf,%lf,%lf%n", &s, &t, &w, &k) == 3;
+                                c = (c[k] == ',') ? c + k + 1 : NULL)
+            if (0 <= s && s <= 1 && 0 <= t && t <= 1 && w > 0)
+                kernel_tap(s, t, (float) w);
+
+        K.r = K.n ? 1.0 / sqrt(K.n) : 0.0;
+    }
+
+    if (K.n == 0)
+    {
+        apperr("Bad sampling kernel '%s'", S);
+        return false;
+    }
+    return true;
+}
+
 // Given the four corner vectors of a sample, compute the five internal vectors
 // of a quincunx filtering of that sample.
 
-static void quincunx(double *q, const double *v)
+static void quincunx(double *q, const double *a, const double *b,
+                                const double *c, const double *d)
 {
-    mid4(q + 12, v +  0, v +  3, v +  6, v +  9);
-    mid2(q +  9, q + 12, v +  9);
-    mid2(q +  6, q + 12, v +  6);
-    mid2(q +  3, q + 12, v +  3);
-    mid2(q +  0, q + 12, v +  0);
+    mid4(q + 12, a, b, c, d);
+    mid2(q +  9, q + 12, d);
+    mid2(q +  6, q + 12, c);
+    mid2(q +  3, q + 12, b);
+    mid2(q +  0, q + 12, a);
 }
 
-// Compute the corner vectors of the pixel at row i column j of the n-by-n
-// page found at row u column v of the w-by-w page array on face f. Sample
-// that pixel by projection into image p using a quincunx filtering pattern.
+// Given the four corner vectors of a sample, compute the tap vectors of the
+// sampling kernel.
 
-static int multisample(img *p, int  f, int  i, int  j, int n,
-                                 long u, long v, long w, float *d)
+static void taps(double *q, const double *a, const double *b,
+                            const double *c, const double *d)
 {
-    double c[12];
-    double C[15];
-    int    N = 0;
+    if (K.q)
+        quincunx(q, a, b, c, d);
+    else
+        for (int k = 0; k < K.n; k++)
+        {
+            const double *e = K.c[k];
+
+            q[3 * k + 0] = e[0] * a[0] + e[1] * b[0] + e[2] * c[0] + e[3] * d[0];
+            q[3 * k + 1] = e[0] * a[1] + e[1] * b[1] + e[2] * c[1] + e[3] * d[1];
+            q[3 * k + 2] = e[0] * a[2] + e[1] * b[2] + e[2] * c[2] + e[3] * d[2];
+
+            normalize(q + 3 * k);
+        }
+}
+
+// Sample columns j0 through j1 - 1 of row i of the page with corner grid g by
+// projection into image p, using the sampling kernel for each pixel. Find the
+// tap vectors of every pixel of the span, sample them all at once, and
+// accumulate each pixel's weighted hits. Given an approximate transform G of
+// the grid, sample the taps by their grid positions instead. If F is set,
+// filter through the image pyramid. C, T, and H are scratch buffers for the
+// tap coordinates, samples, and hits of the span. Return the sample hit count.
+
+static int row(scm *s, img *p, int i, int j0, int j1, const double *g,
+                                       const img_grid *G, float *q, int F,
+                                       double *C, float *T, int *H)
+{
+    const int n = scm_get_n(s);
+    const int c = scm_get_c(s);
+    const int e = K.n;
+    const int k = j1 - j0;
+
+    const double *a = g + 3 * (size_t) (n + 1) * (size_t) i;
+    const double *b = a + 3 * (size_t) (n + 1);
+
+    const double *m = a + 3 * (n / 2);
+
+    double r = 0.0;
+    int    M = 0;
+
+    if (G == NULL)
+        for (int j = j0; j < j1; j++)
+            taps(C + 3 * e * (j - j0), a + 3 * j,     b + 3 * j,
+                                       a + 3 * j + 3, b + 3 * j + 3);
+    else
+        for (int j = j0; j < j1; j++)
+            for (int l = 0; l < e; l++)
+            {
+                C[2 * (e * (j - j0) + l) + 0] = i + K.o[l][0];
+                C[2 * (e * (j - j0) + l) + 1] = j + K.o[l][1];
+            }
 
-    scm_get_sample_corners(f, n * u + i, n * v + j, n * w, c);
+    // Given a pyramid, filter each sample over the tap spacing.
 
-    quincunx(C, c);
+    if (F && p->mip)
+        r = K.r * sqrt((m[3] - m[0]) * (m[3] - m[0]) +
+                       (m[4] - m[1]) * (m[4] - m[1]) +
+                       (m[5] - m[2]) * (m[5] - m[2]));
 
-    for (int l = 0; l < 5; l++)
+    if (G == NULL)
+        img_sample_n(p, e * k, C, r, T, H);
+    else
+        img_sample_grid(p, G, e * k, C, r, K.r, T, H);
+
+    for (int j = j0; j < j1; j++)
     {
-        float t[4];
+        float *d = q + c * (((size_t) n + 2) * ((size_t) i + 1)
+                                             + ((size_t) j + 1));
+        float  W = 0;
+        int    N = 0;
 
-        if (img_sample(p, C + l * 3, t))
+        for (int l = 0; l < e; l++)
+        {
+            const float *t = T + p->c * (e * (j - j0) + l);
+            const float  w = K.w[l];
+
+            if (H[e * (j - j0) + l])
+            {
+                switch (p->c)
+                {
+                    case 4: d[3] += w * t[3];
+                    case 3: d[2] += w * t[2];
+                    case 2: d[1] += w * t[1];
+                    case 1: d[0] += w * t[0];
+                }
+                W += w;
+                N += 1;
+            }
+        }
+        if (N)
         {
             switch (p->c)
             {
-                case 4: d[3] += t[3];
-                case 3: d[2] += t[2];
-                case 2: d[1] += t[1];
-                case 1: d[0] += t[0];
+                case 4: d[3] /= W;
+                case 3: d[2] /= W;
+                case 2: d[1] /= W;
+                case 1: d[0] /= W;
             }
-            N += 1;
         }
-    }
-    if (N)
-    {
-        switch (p->c)
+
+        // Create the alpha channel and swap to BGRA, as necessary.
+
+        if (p->c < c)
         {
-            case 4: d[3] /= N;
-            case 3: d[2] /= N;
-            case 2: d[1] /= N;
-            case 1: d[0] /= N;
+            if (p->b == 8 && p->c == 3)
+            {
+                d[3] = d[0];
+                d[0] = d[2];
+                d[2] = d[3];
+            }
+            d[p->c] = W / K.W;
         }
+        M += N;
     }
-    return N;
+
+    return M;
 }
 
-// Determine the value of the pixel at row i column j of the page found at row
-// u column v of the w-by-w page array on face f. Return the sample hit count.
+// A block of page pixels, keyed for traversal by the first source image row
+// it touches, with pixel blocks that miss the image last. Ties fall back to the
+// Z-order of the block within the page.
+
+#define BLOCK 32
 
-static int pixel(scm *s, img *p, int  f, int  i, int  j,
-                                 long u, long v, long w, float *q)
+typedef struct
 {
-    // Sample the image.
+    int r0;
+    int r1;
+    int z;
+    int i;
+    int j;
+} block;
 
-    const int n = scm_get_n(s);
+static int bcompare(const void *p, const void *q)
+{
+    const block *a = (const block *) p;
+    const block *b = (const block *) q;
+
+    if      (a->r0 < b->r0) return -1;
+    else if (a->r0 > b->r0) return +1;
+    else if (a->z  < b->z)  return -1;
+    else if (a->z  > b->z)  return +1;
+    else                    return  0;
+}
+
+// Find the key of the block of page pixels with its first pixel at row i
+// column j of the page with corner grid g, using its four corners and center
+// to locate its footprint in image p.
+
+static void block_init(block *a, img *p, const double *g, int n, int i, int j)
+{
+    const int i1 = min(i + BLOCK, n);
+    const int j1 = min(j + BLOCK, n);
+
+    double v[15];
+    int    r[2];
+
+    memcpy(v +  0, g + 3 * ((size_t) (n + 1) * i  + j),  3 * sizeof (double));
+    memcpy(v +  3, g + 3 * ((size_t) (n + 1) * i  + j1), 3 * sizeof (double));
+    memcpy(v +  6, g + 3 * ((size_t) (n + 1) * i1 + j),  3 * sizeof (double));
+    memcpy(v +  9, g + 3 * ((size_t) (n + 1) * i1 + j1), 3 * sizeof (double));
+    mid4(v + 12, v, v + 3, v + 6, v + 9);
+
+    a->i = i;
+    a->j = j;
+    a->z = 0;
+
+    for (int k = 0; (1 << k) * BLOCK < n; k++)
+        a->z |= (((i / BLOCK >> k) & 1) << (2 * k + 1))
+             |  (((j / BLOCK >> k) & 1) << (2 * k));
+
+    if (img_rows(p, 5, v, r))
+    {
+        a->r0 = r[0];
+        a->r1 = r[1];
+    }
+    else
+    {
+        a->r0 = INT_MAX;
+        a->r1 = INT_MAX;
+    }
+}
+
+// Sample the page at row u column v of the w-by-w page array on face f into
+// buffer q, using scratch buffer t and corner grid g, through an approximate
+// transform of the grid if one is enabled, and filtering through the image
+// pyramid if F is set. Traverse the page in blocks ordered by their footprint
+// in the image, so that concurrent blocks touch nearby image rows, and advise
+// the paging-in of each block's rows before sampling it. Each thread allocates
+// its row scratch once per page. Return the hit count, or -1 if any allocation
+// fails, leaving the page incomplete.
+
+static int sampage(scm *s, img *p, int f, long u, long v, long w,
+                                   float *q, float *t, double *g, int F)
+{
+    const int o = scm_get_n(s) + 2;
     const int c = scm_get_c(s);
+    const int n = scm_get_n(s);
+    const int m = (n + BLOCK - 1) / BLOCK;
 
-    float *d = q + c * (((size_t) n + 2) * ((size_t) i + 1) + ((size_t) j + 1));
+    block *B;
 
-    int N = multisample(p, f, i, j, n, u, v, w, d);
+    img_grid G;
 
-    // Create the alpha channel and swap to BGRA, as necessary.
+    int N = 0;
+    int k;
+    bool A;
+    bool r = true;
 
-    if (p->c < c)
+    memset(q, 0, (size_t) (o * o * c) * sizeof (float));
+
+    if ((B = (block *) malloc((size_t) m * (size_t) m * sizeof (block))))
     {
-        if (p->b == 8 && p->c == 3)
+        scm_get_page_corners(f, u, v, w, n, g);
+
+        A = img_grid_init(&G, p, n, n, g);
+
+        for (k = 0; k < m * m; ++k)
+            block_init(B + k, p, g, n, BLOCK * (k / m), BLOCK * (k % m));
+
+        qsort(B, (size_t) m * (size_t) m, sizeof (block), bcompare);
+
+        #pragma omp parallel reduction(+:N) reduction(&&:r)
         {
-            d[3] = d[0];
-            d[0] = d[2];
-            d[2] = d[3];
+            const size_t e = (size_t) BLOCK * (size_t) K.n;
+
+            double *C = (double *) malloc(e * 3    * sizeof (double));
+            float  *T = (float  *) malloc(e * p->c * sizeof (float));
+            int    *H = (int    *) malloc(e        * sizeof (int));
+
+            #pragma omp for schedule(dynamic)
+            for (k = 0; k < m * m; ++k)
+            {
+                const int i1 = min(B[k].i + BLOCK, n);
+                const int j1 = min(B[k].j + BLOCK, n);
+
+                if (C && T && H)
+                {
+                    if (B[k].r0 < INT_MAX)
+                        img_prefetch(p, B[k].r0 - 2, B[k].r1 + 2);
+
+                    for (int i = B[k].i; i < i1; ++i)
+                        N += row(s, p, i, B[k].j, j1, g, A ? &G : NULL, q, F,
+                                 C, T, H);
+                }
+            }
+            r = (C && T && H);
+
+            free(H);
+            free(T);
+            free(C);
         }
-        d[p->c] = N / 5.f;
+
+        if (A) img_grid_free(&G);
+
+        free(B);
+    }
+    else r = false;
+
+    if (!r)
+    {
+        apperr("Failed to allocate sampling buffers");
+        return -1;
     }
+
+    if (p->c < c && N && N < n * n * K.n) grow(q, t, c, n);
+
     return N;
 }
 
-// Consider page x of SCM s. Determine whether it contains any of image p.
-// If so, sample it or recursively subdivide it as needed.
+// A node of the page tree traversal gives page x at depth d above the leaves,
+// at row u column v of the w-by-w page array on face f.
 
-static long long divide(scm *s, img *p, long long b, int d, long long x,
-                                        long u, long v, long w, float *q, float *t)
+typedef struct
 {
-    const int f = (int) scm_page_root(x);
-    long long a = b;
+    long long x;
+    int       d;
+    int       f;
+    long      u;
+    long      v;
+    long      w;
+} node;
+
+// Determine whether any of the K images p overlap the given page.
 
-    if (overlap(p, f, u, v, w))
+static bool overlaps(img **p, int K, int f, long u, long v, long w, int d)
+{
+    for (int k = 0; k < K; k++)
+        if (overlap(p[k], f, u, v, w, d))
+            return true;
+
+    return false;
+}
+
+// Pop nodes from the depth-first traversal stack k of length c, discarding
+// those outside the region of interest and subdividing those that overlap any
+// of the K images p, until a node within e levels of the leaves is found. Note
+// it in l and return true, or return false when the traversal is done. Nodes
+// are tested for overlap at output by the caller, as that test may be costly.
+
+static bool next(img **p, int K, int e, node *k, int *c, node *l)
+{
+    while (*c > 0)
     {
-        if (d == 0)
-        {
-            const int o = scm_get_n(s) + 2;
-            const int c = scm_get_c(s);
-            const int n = scm_get_n(s);
+        const node a = k[--(*c)];
 
-            int N = 0;
-            int i;
-            int j;
+        if (!region_overlap(a.f, a.u, a.v, a.w))
+            continue;
 
-            memset(q, 0, (size_t) (o * o * c) * sizeof (float));
+        if (a.d > 0 && overlaps(p, K, a.f, a.u, a.v, a.w, a.d))
+        {
+            long long xv[4];
 
-            #pragma omp parallel for private(j) reduction(+:N)
-            for     (i = 0; i < n; ++i)
-                for (j = 0; j < n; ++j)
-                    N += pixel(s, p, f, i, j, u, v, w, q);
+            scm_page_children(a.x, xv);
 
-            if (p->c < c && N && N < n * n * 5) grow(q, t, c, n);
+            for (int i = 3; i >= 0; i--)
+            {
+                node *b = k + (*c)++;
 
-            if (N) a = scm_append(s, a, x, q);
+                b->x = xv[i];
+                b->d = a.d - 1;
+                b->f = a.f;
+                b->u = a.u * 2 + i / 2;
+                b->v = a.v * 2 + i % 2;
+                b->w = a.w * 2;
+            }
         }
-        else
+        if (a.d <= e)
         {
-            long long x0 = scm_page_child(x, 0);
-            long long x1 = scm_page_child(x, 1);
-            long long x2 = scm_page_child(x, 2);
-            long long x3 = scm_page_child(x, 3);
-
-            a = divide(s, p, a, d - 1, x0, u * 2,     v * 2,     w * 2, q, t);
-            a = divide(s, p, a, d - 1, x1, u * 2,     v * 2 + 1, w * 2, q, t);
-            a = divide(s, p, a, d - 1, x2, u * 2 + 1, v * 2,     w * 2, q, t);
-            a = divide(s, p, a, d - 1, x3, u * 2 + 1, v * 2 + 1, w * 2, q, t);
+            *l = a;
+            return true;
         }
     }
-    return a;
+    return false;
 }
 
-// Convert image p to SCM s with depth d. Allocate working buffers and perform a
-// depth-first traversal of the page tree.
+// Sample the leaf page a from each of the K images p into buffer q. A page
+// sampled from only one image is that image's page. Pages sampled from more
+// are combined using mode O, as by the combine process. Use scratch buffers
+// r, t, and y and corner grid g, and filter through the image pyramids if F is
+// set. Return the total hit count, or zero if any image fails to sample, so
+// that an incomplete page is not written.
 
-static int process(scm *s, int d, img *p)
+static int mosaic(scm *s, img **p, int K, int O, const node *a,
+                  float *q, float *r, float *t, float *y, double *g, int F)
 {
-    float *q;
-    float *t;
+    const size_t S = (size_t) (scm_get_n(s) + 2)
+                   * (size_t) (scm_get_n(s) + 2)
+                   * (size_t) (scm_get_c(s)) * sizeof (float);
+
+    int N = 0;
+    int h;
+    int m;
+    int k;
+
+    for (m = 0, k = 0; k < K; k++)
+        if (overlap(p[k], a->f, a->u, a->v, a->w, 0))
+        {
+            if ((h = sampage(s, p[k], a->f, a->u, a->v, a->w,
+                                          m ? r : q, t, g, F)) < 0)
+                return 0;
+
+            if (h)
+            {
+                if (m == 1)
+                {
+                    memcpy(y, q, S);
+                    memset(q, 0, S);
+                    combine_page(q, y, scm_get_c(s), scm_get_n(s), O);
+                }
+                if (m >= 1)
+                    combine_page(q, r, scm_get_c(s), scm_get_n(s), O);
+
+                N += h;
+                m += 1;
+            }
+        }
+
+    return N;
+}
+
+// Catalog the pages already present in SCM s, as when resuming an interrupted
+// conversion, and return the offset of the last, to which appends will link.
 
-    if ((q = scm_alloc_buffer(s)))
+static long long resume(scm *s)
+{
+    long long b = 0;
+
+    if (scm_scan_catalog(s))
+        for (long long i = 0; i < scm_get_length(s); ++i)
+            if (b < scm_get_offset(s, i))
+                b = scm_get_offset(s, i);
+
+    return b;
+}
+
+// Convert the K images p to SCM s, writing levels D through d, combining
+// overlaps using mode O, and filtering through the image pyramids if F is set.
+// Traverse the page tree depth-first, gathering windows of pages. Sample the
+// pages of each window in parallel, each into its own buffer, and append them
+// in traversal order, so that the output does not depend on the thread count.
+// Each page is written once, however many images contribute to it, and pages
+// already present in a resumed output are not written again.
+
+static int process(scm *s, int d, int D, img **p, int K, int O, int F)
+{
+    const size_t m = (size_t) scm_get_n(s) + 1;
+
+#ifdef _OPENMP
+    const int T = omp_get_max_threads();
+#else
+    const int T = 1;
+#endif
+    const int W = 2 * T;
+
+    node    *k = (node    *) calloc((size_t) (3 * d + 8), sizeof (node));
+    node    *a = (node    *) calloc((size_t) W,           sizeof (node));
+    int     *N = (int     *) calloc((size_t) W,           sizeof (int));
+    float  **q = (float  **) calloc((size_t) W,           sizeof (float *));
+    float  **r = (float  **) calloc((size_t) T,           sizeof (float *));
+    float  **t = (float  **) calloc((size_t) T,           sizeof (float *));
+    float  **y = (float  **) calloc((size_t) T,           sizeof (float *));
+    double **g = (double **) calloc((size_t) T,           sizeof (double *));
+
+    bool st = (k && a && N && q && r && t && y && g);
+    int  i;
+
+    for (i = 0; st && i < W; i++)
+        st = ((q[i] = scm_alloc_buffer(s)) != NULL);
+    for (i = 0; st && i < T; i++)
+        st = ((t[i] = scm_alloc_buffer(s)) != NULL) &&
+             ((g[i] = (double *) malloc(m * m * 3 * sizeof (double))) != NULL);
+    for (i = 0; st && i < T && K > 1; i++)
+        st = ((r[i] = scm_alloc_buffer(s)) != NULL) &&
+             ((y[i] = scm_alloc_buffer(s)) != NULL);
+
+    if (st)
     {
-        if ((t = scm_alloc_buffer(s)))
+        long long b = resume(s);
+        long long l = scm_get_length(s);
+        bool      o = true;
+        int       c = 0;
+        int       e;
+
+        for (i = 5; i >= 0; i--, c++)
         {
-            long long b = 0;
+            k[c].x = i;
+            k[c].d = d;
+            k[c].f = i;
+            k[c].u = 0;
+            k[c].v = 0;
+            k[c].w = 1;
+        }
 
-            b = divide(s, p, b, d, 0, 0, 0, 1, q, t);
-            b = divide(s, p, b, d, 1, 0, 0, 1, q, t);
-            b = divide(s, p, b, d, 2, 0, 0, 1, q, t);
-            b = divide(s, p, b, d, 3, 0, 0, 1, q, t);
-            b = divide(s, p, b, d, 4, 0, 0, 1, q, t);
-            b = divide(s, p, b, d, 5, 0, 0, 1, q, t);
+        do
+        {
+            for (e = 0; e < W && next(p, K, d - D, k, &c, a + e); )
+                if (l == 0 || scm_search(s, a[e].x) < 0)
+                    e++;
 
-            free(t);
+            #pragma omp parallel for schedule(dynamic) if (e > 1)
+            for (i = 0; i < e; i++)
+            {
+#ifdef _OPENMP
+                const int j = omp_get_thread_num();
+#else
+                const int j = 0;
+#endif
+                N[i] = mosaic(s, p, K, O, a + i, q[i], r[j], t[j], y[j], g[j], F);
+            }
+
+            // Stop at the first failed append, as any page linked after it
+            // would orphan those already written.
+
+            for (i = 0; o && i < e; i++)
+                if (N[i] && (b = scm_append(s, b, a[i].x, q[i])) == 0)
+                {
+                    apperr("Failed to append page %lld", a[i].x);
+                    o = false;
+                }
         }
-        free(q);
+        while (o && e);
     }
+
+    for (i = 0; g && i < T; i++) free(g[i]);
+    for (i = 0; y && i < T; i++) free(y[i]);
+    for (i = 0; t && i < T; i++) free(t[i]);
+    for (i = 0; r && i < T; i++) free(r[i]);
+    for (i = 0; q && i < W; i++) free(q[i]);
+
+    free(g);
+    free(y);
+    free(t);
+    free(r);
+    free(q);
+    free(N);
+    free(a);
+    free(k);
+
     return 0;
 }
 
 //------------------------------------------------------------------------------
 
-int convert(int argc, char **argv, const char *o,
-                                           int n,
-                                           int d,
-                                           int b,
-                                           int g,
-                                           int A,
-                                 const float  *N,
-                                 const double *E,
-                                 const double *L,
-                                 const double *P)
+// Load the named input image and apply the format, blending, subset, and
+// normalization parameters to it. The channel format overrides b and g take
+// the format of the first image loaded unless given. If F is set, read any
+// TIFF overviews and complete the image's pyramid. A JPEG is decoded only at
+// the resolution needed by an SCM of page size n and depth d, allowing twice
+// the equatorial pixel count as the cube map is denser toward the corners of
+// its faces.
+
+static img *load(const char *in, int n, int d, int *b, int *g, int F,
+                                                 const float  *N,
+                                                 const double *E,
+                                                 const double *L,
+                                                 const double *P)
 {
-    img  *p = NULL;
-    scm  *s = NULL;
-    const char *e = NULL;
+    img *p = NULL;
 
-    char out[256];
+    double w = 8.0 * n * pow(2.0, d);
+    double h = 4.0 * n * pow(2.0, d);
 
-    init_tap(0, 1, MTAPS, tap);
+    if (E[0] || E[1] || E[2] || E[3])
+    {
+        w *= fabs(E[1] - E[0]) / 360.0;
+        h *= fabs(E[3] - E[2]) / 180.0;
+    }
 
-    // Iterate over all input file arguments.
+    w = ceil(min(w, INT_MAX));
+    h = ceil(min(h, INT_MAX));
 
-    for (int i = 0; i < argc; i++)
+    if      (extcmp(in, ".jpg") == 0) p = jpg_load(in, (int) w, (int) h);
+    else if (extcmp(in, ".png") == 0) p = png_load(in);
+    else if (extcmp(in, ".tif") == 0) p = tif_load(in, F);
+    else if (extcmp(in, ".img") == 0) p = pds_load(in);
+    else if (extcmp(in, ".lbl") == 0) p = pds_load(in);
+
+    if (p)
     {
-        const char *in = argv[i];
+        // Allow the channel format overrides.
 
-        // Generate the output file name.
+        if (*b == -1) *b = p->b;
+        if (*g == -1) *g = p->g;
 
-        if (o) strcpy(out, o);
+        // Set the blending parameters.
 
-        else if ((e = strrchr(in, '.')))
+        if (P[0] || P[1] || P[2])
+        {
+            p->latc = P[0] * M_PI / 180.0;
+            p->lat0 = P[1] * M_PI / 180.0;
+            p->lat1 = P[2] * M_PI / 180.0;
+        }
+        if (L[0] || L[1] || L[2])
         {
-            memset (out, 0, 256);
-            strncpy(out, in, e - in);
-            strcat (out, ".tif");
+            p->lonc = L[0] * M_PI / 180.0;
+            p->lon0 = L[1] * M_PI / 180.0;
+            p->lon1 = L[2] * M_PI / 180.0;
         }
-        else strcpy(out, "out.tif");
 
-        // Load the input file.
+        // Set the equirectangular subset parameters.
 
-        if      (extcmp(in, ".jpg") == 0) p = jpg_load(in);
-        else if (extcmp(in, ".png") == 0) p = png_load(in);
-        else if (extcmp(in, ".tif") == 0) p = tif_load(in);
-        else if (extcmp(in, ".img") == 0) p = pds_load(in);
-        else if (extcmp(in, ".lbl") == 0) p = pds_load(in);
+        if (E[0] || E[1] || E[2] || E[3])
+        {
+            p->westernmost_longitude = E[0] * M_PI / 180.0;
+            p->easternmost_longitude = E[1] * M_PI / 180.0;
+            p->minimum_latitude = E[2] * M_PI / 180.0;
+            p->maximum_latitude = E[3] * M_PI / 180.0;
+            p->project = img_default;
+        }
 
-        if (p)
+        // Set the normalization parameters.
+
+        if (N[0] || N[1])
+        {
+            p->norm0 = N[0];
+            p->norm1 = N[1];
+        }
+        else if (*b == 8)
+        {
+            if (*g) { p->norm0 = 0.0f; p->norm1 =   127.0f; }
+            else    { p->norm0 = 0.0f; p->norm1 =   255.0f; }
+        }
+        else if (*b == 16)
         {
-            // Allow the channel format overrides.
+            if (*g) { p->norm0 = 0.0f; p->norm1 = 32767.0f; }
+            else    { p->norm0 = 0.0f; p->norm1 = 65535.0f; }
+        }
+        else
+        {
+            p->norm0 = 0.0f;
+            p->norm1 = 1.0f;
+        }
 
-            if (b == -1) b = p->b;
-            if (g == -1) g = p->g;
+        // Apply the normalization to any overview levels, build the pyramid,
+        // and stage the normalized channels.
 
-            // Set the blending parameters.
+        for (img *q = p->mip; q; q = q->mip)
+        {
+            q->norm0          = p->norm0;
+            q->norm1          = p->norm1;
+            q->scaling_factor = p->scaling_factor;
+            q->offset         = p->offset;
+        }
 
-            if (P[0] || P[1] || P[2])
-            {
-                p->latc = P[0] * M_PI / 180.0;
-                p->lat0 = P[1] * M_PI / 180.0;
-                p->lat1 = P[2] * M_PI / 180.0;
-            }
-            if (L[0] || L[1] || L[2])
-            {
-                p->lonc = L[0] * M_PI / 180.0;
-                p->lon0 = L[1] * M_PI / 180.0;
-                p->lon1 = L[2] * M_PI / 180.0;
-            }
+        if (F) img_pyramid(p);
 
-            // Set the equirectangular subset parameters.
+        img_stage(p);
+    }
+    return p;
+}
 
-            if (E[0] || E[1] || E[2] || E[3])
-            {
-                p->westernmost_longitude = E[0] * M_PI / 180.0;
-                p->easternmost_longitude = E[1] * M_PI / 180.0;
-                p->minimum_latitude = E[2] * M_PI / 180.0;
-                p->maximum_latitude = E[3] * M_PI / 180.0;
-                p->project = img_default;
-            }
+// Convert all input images to a single SCM, combining them using mode m. If u
+// is set, resume the conversion of an existing partial output.
 
-            // Set the normalization parameters.
+static void convert_mosaic(int argc, char **argv, const char *out,
+                           const char *m, int n, int d, int D, int b, int g,
+                                                 int A, int F, int u,
+                           const float  *N, const double *E,
+                           const double *L, const double *P)
+{
+    img **p;
+    scm  *s;
+    int   K = 0;
 
-            if (N[0] || N[1])
-            {
-                p->norm0 = N[0];
-                p->norm1 = N[1];
-            }
-            else if (b == 8)
-            {
-                if (g) { p->norm0 = 0.0f; p->norm1 =   127.0f; }
-                else   { p->norm0 = 0.0f; p->norm1 =   255.0f; }
-            }
-            else if (b == 16)
-            {
-                if (g) { p->norm0 = 0.0f; p->norm1 = 32767.0f; }
-                else   { p->norm0 = 0.0f; p->norm1 = 65535.0f; }
-            }
-            else
+    if ((p = (img **) calloc((size_t) argc, sizeof (img *))))
+    {
+        for (int i = 0; i < argc; i++)
+            if ((p[K] = load(argv[i], n, d, &b, &g, F, N, E, L + 3 * i,
+                                                             P + 3 * i)))
             {
-                p->norm0 = 0.0f;
-                p->norm1 = 1.0f;
+                if (p[K]->c == p[0]->c)
+                    K++;
+                else
+                {
+                    apperr("Image '%s' has chan %d. Expected chan %d.",
+                                        argv[i], p[K]->c, p[0]->c);
+                    img_close(p[K]);
+                }
             }
 
-            // Process the output.
-
-            if ((s = scm_ofile(out, n, p->c + A, b, g)))
+        if (K)
+        {
+            if ((s = u ? scm_rfile(out, n, p[0]->c + A, b, g)
+                       : scm_ofile(out, n, p[0]->c + A, b, g)))
             {
-                process(s, d, p);
+                process(s, d, D, p, K, combine_mode(m), F);
                 scm_close(s);
             }
-            img_close(p);
         }
+        for (int k = 0; k < K; k++)
+            img_close(p[k]);
+
+        free(p);
     }
+}
+
+// Generate the output file name of input in, given output name o, if any.
+
+static void outname(char *out, const char *in, const char *o)
+{
+    const char *e = NULL;
+
+    if (o) strcpy(out, o);
+
+    else if ((e = strrchr(in, '.')))
+    {
+        memset (out, 0, 256);
+        strncpy(out, in, e - in);
+        strcat (out, ".tif");
+    }
+    else strcpy(out, "out.tif");
+}
+
+// Return the size of the named file in bytes, or zero if it cannot be found.
+
+static long long filesize(const char *name)
+{
+    struct stat st;
+
+    if (stat(name, &st) == 0)
+        return (long long) st.st_size;
+    else
+        return 0;
+}
+
+// Convert the named input image to its own SCM. If u is set, resume the
+// conversion of an existing partial output.
+
+static void convert_one(const char *in, const char *out,
+                        int n, int d, int D, int b, int g, int A, int F, int u,
+                        const float  *N, const double *E,
+                        const double *L, const double *P)
+{
+    img *p;
+    scm *s;
+
+    if ((p = load(in, n, d, &b, &g, F, N, E, L, P)))
+    {
+        if ((s = u ? scm_rfile(out, n, p->c + A, b, g)
+                   : scm_ofile(out, n, p->c + A, b, g)))
+        {
+            process(s, d, D, &p, 1, 0, F);
+            scm_close(s);
+        }
+        img_close(p);
+    }
+}
+
+// Convert the K inputs indexed by x concurrently, up to J at a time. Each job
+// receives an even share of the threads, of the image memory budget, and of the
+// staging limit, so that the batch as a whole stays within all three.
+
+static void convert_jobs(char **argv, char (*out)[256], const int *x, int K,
+                        int J, int n, int d, int D, int b, int g,
+                                     int A, int F, int u,
+                        const float  *N, const double *E,
+                        const double *L, const double *P)
+{
+#ifdef _OPENMP
+    const int T = omp_get_max_threads();
+#else
+    const int T = 1;
+#endif
+    const size_t M = img_get_budget();
+    const size_t Z = img_get_stage();
+    const int    t = max(1, T / J);
+    int          k;
+
+    if (M) img_set_budget(M / (size_t) J);
+    if (Z) img_set_stage (Z / (size_t) J);
+
+#ifdef _OPENMP
+#if _OPENMP >= 200805
+    const int V = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+#else
+    const int V = omp_get_nested();
+    omp_set_nested(1);
+#endif
+#endif
+
+    #pragma omp parallel for schedule(dynamic) num_threads(J)
+    for (k = 0; k < K; k++)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(t);
+#endif
+        convert_one(argv[x[k]], out[x[k]], n, d, D, b, g, A, F, u, N, E,
+                                           L + 3 * x[k], P + 3 * x[k]);
+    }
+
+#ifdef _OPENMP
+#if _OPENMP >= 200805
+    omp_set_max_active_levels(V);
+#else
+    omp_set_nested(V);
+#endif
+#endif
+
+    img_set_budget(M);
+    img_set_stage (Z);
+}
+
+// Convert each input image to its own SCM. Inputs larger than an even share of
+// the batch are converted one at a time, each parallelized across all threads.
+// The rest, too small to occupy all threads alone, are converted concurrently,
+// up to J at a time, or as many as there are threads if J is zero. Inputs that
+// share an output name are all converted in order.
+
+static void convert_batch(int argc, char **argv, const char *o,
+                          int n, int d, int D, int b, int g,
+                          int A, int F, int u, int J,
+                          const float  *N, const double *E,
+                          const double *L, const double *P)
+{
+    char     (*out)[256] = (char (*)[256]) calloc((size_t) argc, 256);
+    long long *z         = (long long *)   calloc((size_t) argc, sizeof (long long));
+    int       *x         = (int *)         calloc((size_t) argc, sizeof (int));
+
+    if (out && z && x)
+    {
+        long long Z = 0;
+        int       K = 0;
+        int       i;
+        int       k;
+
+#ifdef _OPENMP
+        if (J < 1) J = omp_get_max_threads();
+#else
+        J = 1;
+#endif
+        J = max(1, min(J, argc));
+
+        for (i = 0; i < argc; i++)
+        {
+            outname(out[i], argv[i], o);
+            Z += (z[i] = filesize(argv[i]));
+        }
+
+        for (i = 0; i < argc; i++)
+            for (k = 0; k < i; k++)
+                if (strcmp(out[i], out[k]) == 0)
+                    J = 1;
+
+        // Convert the large inputs and queue the small ones.
+
+        for (i = 0; i < argc; i++)
+            if (J == 1 || z[i] * J > Z)
+                convert_one(argv[i], out[i], n, d, D, b, g, A, F, u, N, E,
+                                                  L + 3 * i, P + 3 * i);
+            else
+                x[K++] = i;
+
+        if (K)
+            convert_jobs(argv, out, x, K, min(J, K), n, d, D, b, g, A, F, u,
+                                                     N, E, L, P);
+    }
+
+    free(x);
+    free(z);
+    free(out);
+}
+
+int convert(int argc, char **argv, const char *o,
+                                   const char *m,
+                                   const char *S,
+                                   const char *Q,
+                                           int n,
+                                           int d,
+                                           int D,
+                                           int b,
+                                           int g,
+                                           int A,
+                                           int F,
+                                           int u,
+                                           int J,
+                                 const float  *N,
+                                 const double *E,
+                                 const double *B,
+                                 const double *L,
+                                 const double *P)
+{
+    init_tap(0, 1, MTAPS, tap);
+
+    if (!kernel_init(S) || !region_init(B, Q))
+        return -1;
+
+    if (D < 0 || D > d)
+        D = d;
+
+    // Given a combination mode, mosaic all input files into one output.
+
+    if (m)
+        convert_mosaic(argc, argv, o ? o : "out.tif", m, n, d, D, b, g,
+                                                      A, F, u, N, E, L, P);
+
+    // Otherwise convert each input file to its own output.
+
+    else
+        convert_batch(argc, argv, o, n, d, D, b, g, A, F, u, J, N, E, L, P);
+
     return 0;
 }
 
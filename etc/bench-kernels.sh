@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# ./bench-kernels.sh $1 $2 $3
+#     $1 is the input image
+#     $2 is the page size
+#     $3 is the tree depth
+
+# Convert the input using each sampling kernel and report the time taken and
+# the RMS difference from a reference converted two levels deeper with a 4x4
+# kernel and mipmapped to the same depth.
+
+ref="bench-ref.tif"
+out="bench-out.tif"
+pts="bench-pts.txt"
+
+# Generate random sample locations.
+
+awk 'BEGIN { srand(1); for (i = 0; i < 10000; i++)
+                 printf("%f %f\n", 160 * rand() - 80, 360 * rand()) }' > $pts
+
+# Convert the reference.
+
+scmtiff -pconvert -n$2 -d$(($3 + 2)) -S4x4 -o$ref $1
+scmtiff -pmipmap -mavg $ref
+scmtiff -psample -d$3 $ref < $pts | cut -d' ' -f1 > $ref.txt
+
+# Convert and compare each kernel.
+
+for k in 1 5 2x2 3x3 4x4; do
+
+    t=$(scmtiff -T -pconvert -n$2 -d$3 -S$k -o$out $1)
+
+    scmtiff -pmipmap -mavg $out
+    scmtiff -psample -d$3 $out < $pts | cut -d' ' -f1 > $out.txt
+
+    e=$(paste $ref.txt $out.txt | awk '{ e += ($1 - $2) * ($1 - $2); n++ }
+                                   END { printf("%f", sqrt(e / n)) }')
+
+    printf "%s\t%s\trms %s\n" $k $t $e
+done
+
+rm -f $ref $out $pts $ref.txt $out.txt
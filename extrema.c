@@ -30,9 +30,9 @@ int extrema(int argc, char **argv)
 
         // Load the input file.
 
-        if      (extcmp(in, ".jpg") == 0) p = jpg_load(in);
+        if      (extcmp(in, ".jpg") == 0) p = jpg_load(in, 0, 0);
         else if (extcmp(in, ".png") == 0) p = png_load(in);
-        else if (extcmp(in, ".tif") == 0) p = tif_load(in);
+        else if (extcmp(in, ".tif") == 0) p = tif_load(in, 0);
         else if (extcmp(in, ".img") == 0) p = pds_load(in);
         else if (extcmp(in, ".lbl") == 0) p = pds_load(in);
 
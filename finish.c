@@ -21,47 +21,6 @@
 
 //------------------------------------------------------------------------------
 
-static char *load_txt(const char *name)
-{
-    // Load the named file into a newly-allocated buffer.
-
-    FILE *fp = 0;
-    void  *p = 0;
-    size_t n = 0;
-
-    if ((fp = fopen(name, "rb")))
-    {
-        if (fseek(fp, 0, SEEK_END) == 0)
-        {
-            if ((n = (size_t) ftell(fp)))
-            {
-                if (fseek(fp, 0, SEEK_SET) == 0)
-                {
-                    if ((p = calloc(n + 1, 1)))
-                    {
-                        if (fread(p, 1, n, fp) == n)
-                        {
-                            // The top of the mountain.
-                        }
-                        else apperr("Failure to read %s", name);
-                    }
-                    else apperr("Failure to allocate %s", name);
-                }
-                else apperr("Failed to seek %s", name);
-            }
-            else apperr("Failed to tell %s", name);
-        }
-        else apperr("Failed to seek %s", name);
-    }
-    else apperr("Failed to open %s", name);
-
-    fclose(fp);
-
-    return (char *) p;
-}
-
-//------------------------------------------------------------------------------
-
 int finish(int argc, char **argv, const char *t, int l)
 {
     for (int i = 0; i < argc; i++)
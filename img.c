@@ -10,6 +10,10 @@
 // FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
 // more details.
 
+#ifndef _WIN32
+#define _XOPEN_SOURCE 600
+#endif
+
 #include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -25,9 +29,99 @@
 
 //------------------------------------------------------------------------------
 
+// Pixel buffers larger than this many bytes are backed by a temporary file.
+// Zero places all pixel buffers in memory.
+
+static size_t budget = 0;
+
+void img_set_budget(size_t n)
+{
+    budget = n;
+}
+
+size_t img_get_budget(void)
+{
+    return budget;
+}
+
+// Map a read-write buffer of size n backed by a new temporary file, which is
+// removed as soon as it is closed. Pages of the image in excess of available
+// memory are paged out to this file rather than to swap, so an image of any
+// size may be decoded and sampled.
+
+static void *img_spill(img *p, size_t n)
+{
+#ifndef _WIN32
+    const char *t = getenv("TMPDIR");
+
+    char  name[256];
+    void *q;
+    int   d;
+
+    snprintf(name, 256, "%s/scmtiffXXXXXX", t ? t : "/tmp");
+
+    if ((d = mkstemp(name)) != -1)
+    {
+        unlink(name);
+
+        if (ftruncate(d, (off_t) n) == 0)
+        {
+            if ((q = mmap(0, n, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, d, 0)) != MAP_FAILED)
+            {
+                p->q = q;
+                p->d = d;
+                return q;
+            }
+            else syserr("Failed to mmap '%s'", name);
+        }
+        else syserr("Failed to size '%s'", name);
+
+        close(d);
+    }
+    else syserr("Failed to create '%s'", name);
+#else
+    char   path[MAX_PATH];
+    char   name[MAX_PATH];
+    LPVOID q;
+    HANDLE hF;
+    HANDLE hFM;
+
+    GetTempPath(MAX_PATH, path);
+    GetTempFileName(path, "scm", 0, name);
+
+    if ((hF = CreateFile(name, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                        CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY |
+                                       FILE_FLAG_DELETE_ON_CLOSE, NULL))
+                                          != INVALID_HANDLE_VALUE)
+    {
+        if ((hFM = CreateFileMapping(hF, NULL, PAGE_READWRITE,
+                                     (DWORD) ((unsigned long long) n >> 32),
+                                     (DWORD) ((unsigned long long) n), NULL)))
+        {
+            if ((q = MapViewOfFile(hFM, FILE_MAP_WRITE, 0, 0, n)))
+            {
+                p->hF  = hF;
+                p->hFM = hFM;
+                return q;
+            }
+            else syserr("Failed to map '%s'", name);
+
+            CloseHandle(hFM);
+        }
+        else syserr("Failed to create file mapping '%s'", name);
+
+        CloseHandle(hF);
+    }
+    else syserr("Failed to create '%s'", name);
+#endif
+    return NULL;
+}
+
 // Allocate, initialize, and return an image structure representing a pixel
 // buffer with width w, height h, channel count c, bits-per-channel count b,
 // and signedness g.
+// A buffer exceeding the budget is backed by a temporary file.
 
 img *img_alloc(int w, int h, int c, int b, int g)
 {
@@ -36,7 +130,7 @@ img *img_alloc(int w, int h, int c, int b, int g)
 
     if ((p = (img *) calloc(1, sizeof (img))))
     {
-        if ((p->p = malloc(n)))
+        if ((p->p = (budget && n > budget) ? img_spill(p, n) : malloc(n)))
         {
             p->project = img_default;
             p->n = n;
@@ -72,6 +166,10 @@ void img_close(img *p)
 {
     if (p)
     {
+        img_close(p->mip);
+
+        free(p->f);
+
 #ifndef _WIN32
         if (p->q)
             munmap(p->q, p->n);
@@ -233,7 +331,18 @@ static int getchan(const img *p, int i, int j, int k, float *f)
 {
     const size_t s = ((size_t) p->w * i + j) * ((size_t) p->c) + k;
 
-    if (p->b == 32)
+    if (p->f)
+    {
+        if (p->f[s] == p->f[s])
+        {
+            *f = p->f[s];
+            return 1;
+        }
+        *f = (0.f * p->scaling_factor + p->offset - p->norm0)
+                                      / (p->norm1 - p->norm0);
+        return 0;
+    }
+    else if (p->b == 32)
     {
         return normf(p, getfloat(p, (const float *) p->p + s), f);
     }
@@ -273,6 +382,301 @@ int img_pixel(img *p, int i, int j, float *c)
     return d;
 }
 
+//------------------------------------------------------------------------------
+
+// Read the raw value of channel k of pixel (i, j) of image p into v, with the
+// byte order corrected. Saturation codes give the saturated values, as norms16
+// and normf take them. Return 0 if the value is null or out of range.
+
+static int getraw(const img *p, int i, int j, int k, double *v)
+{
+    const size_t s = ((size_t) p->w * i + j) * ((size_t) p->c) + k;
+
+    if (p->b == 32)
+    {
+        const float     e = getfloat(p, (const float *) p->p + s);
+        const uint32_t *w = (const uint32_t *) &e;
+
+        int d = 1;
+
+        if      (*w == 0xFF7FFFFB)  d = 0;  // Null
+        else if (*w == 0xFF7FFFFC) *v = 0;  // Representation  saturation low
+        else if (*w == 0xFF7FFFFD) *v = 0;  // Instrumentation saturation low
+        else if (*w == 0xFF7FFFFE) *v = 1;  // Representation  saturation high
+        else if (*w == 0xFF7FFFFF) *v = 1;  // Instrumentation saturation high
+        else if (isnormal(e))      *v = e;  // Good
+        else                        d = 0;  // Punt
+
+        return d;
+    }
+    else if (p->b == 16)
+    {
+        if (p->g)
+        {
+            const int16_t e = getint16(p, (const int16_t *) p->p + s);
+
+            int d = 1;
+
+            if      (e == -32768)  d =      0;  // Null
+            else if (e == -32767) *v = -32768;  // Representation  saturation low
+            else if (e == -32766) *v = -32768;  // Instrumentation saturation low
+            else if (e == -32764) *v =  32767;  // Representation  saturation high
+            else if (e == -32765) *v =  32767;  // Instrumentation saturation high
+            else                  *v =      e;  // Good
+
+            return d;
+        }
+        else
+        {
+            *v = getuint16(p, (const uint16_t *) p->p + s);
+            return 1;
+        }
+    }
+    else if (p->b == 8)
+    {
+        if (p->g)
+            *v = ((const  int8_t *) p->p)[s];
+        else
+            *v = ((const uint8_t *) p->p)[s];
+        return 1;
+    }
+    return 0;
+}
+
+// Store raw value v to channel k of pixel (i, j) of image p, in native byte
+// order, or store the null value if d is zero. Signed 16-bit values below the
+// range of good values are stored as saturated low, so they are not read back
+// as null or as another saturation code.
+
+static void putraw(img *p, int i, int j, int k, double v, int d)
+{
+    const size_t s = ((size_t) p->w * i + j) * ((size_t) p->c) + k;
+
+    if (p->b == 32)
+    {
+        const uint32_t n = 0xFF7FFFFB;
+
+        if (d)
+            ((float *) p->p)[s] = (float) v;
+        else
+            memcpy((float *) p->p + s, &n, sizeof (float));
+    }
+    else if (p->b == 16)
+    {
+        if (p->g)
+        {
+            const double r = floor(v + 0.5);
+
+            if      (d == 0)     ((int16_t *) p->p)[s] = -32768;
+            else if (r < -32763) ((int16_t *) p->p)[s] = -32767;
+            else                 ((int16_t *) p->p)[s] = (int16_t) r;
+        }
+        else
+            ((uint16_t *) p->p)[s] = (uint16_t) floor(v + 0.5);
+    }
+    else if (p->b == 8)
+    {
+        if (p->g)
+            ((int8_t   *) p->p)[s] = (int8_t)   floor(v + 0.5);
+        else
+            ((uint8_t  *) p->p)[s] = (uint8_t)  floor(v + 0.5);
+    }
+}
+
+// Return a new image of half the size of image p, each pixel of which is the
+// average of the valid values of a 2-by-2 block of pixels of p.
+
+static img *img_reduce(img *p)
+{
+    img *q;
+
+    if ((q = img_alloc((p->w + 1) / 2, (p->h + 1) / 2, p->c, p->b, p->g)))
+    {
+        int i;
+
+        #pragma omp parallel for
+        for (i = 0; i < q->h; i++)
+            for (int j = 0; j < q->w; j++)
+                for (int k = 0; k < q->c; k++)
+                {
+                    const int i0 = 2 * i, i1 = min(2 * i + 1, p->h - 1);
+                    const int j0 = 2 * j, j1 = min(2 * j + 1, p->w - 1);
+
+                    double v, a = 0;
+                    int       d = 0;
+
+                    if (getraw(p, i0, j0, k, &v)) { a += v; d++; }
+                    if (getraw(p, i0, j1, k, &v)) { a += v; d++; }
+                    if (getraw(p, i1, j0, k, &v)) { a += v; d++; }
+                    if (getraw(p, i1, j1, k, &v)) { a += v; d++; }
+
+                    putraw(q, i, j, k, d ? a / d : 0, d);
+                }
+    }
+    return q;
+}
+
+// Complete the pyramid of image p, halving the size of each level until it is
+// a single pixel. Levels already present, such as TIFF overviews, are kept.
+// All levels take the value normalization of p. Return the level count.
+
+int img_pyramid(img *p)
+{
+    int n = 0;
+
+    for (img *q = p; q; q = q->mip, n++)
+    {
+        if (q->mip == NULL && (q->w > 1 || q->h > 1))
+            q->mip = img_reduce(q);
+
+        if (q->mip)
+        {
+            q->mip->norm0          = p->norm0;
+            q->mip->norm1          = p->norm1;
+            q->mip->scaling_factor = p->scaling_factor;
+            q->mip->offset         = p->offset;
+        }
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+
+// Images whose staged channel buffers total at most this many bytes are staged.
+// Zero disables staging.
+
+static size_t stage = 0;
+
+void img_set_stage(size_t n)
+{
+    stage = n;
+}
+
+size_t img_get_stage(void)
+{
+    return stage;
+}
+
+// Byte-swap the n 16-bit or 32-bit values of s into d. These loops are simple
+// enough for the compiler to vectorize.
+
+static void swap16(uint16_t *d, const uint16_t *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        d[i] = (uint16_t) ((s[i] >> 8) | (s[i] << 8));
+}
+
+static void swap32(uint32_t *d, const uint32_t *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        d[i] = ((s[i] >> 24)             ) | ((s[i] >>  8) & 0x0000FF00u)
+             | ((s[i] <<  8) & 0x00FF0000u) | ((s[i] << 24)             );
+}
+
+// Stage row i of image p, reading its raw values into native order in scratch
+// buffer t, and normalizing them into the staging buffer. Nulls become NaN.
+
+static void stage_row(img *p, int i, void *t)
+{
+    const size_t n = (size_t) p->w * (size_t) p->c;
+    const void  *s = img_scanline(p, i);
+    float       *d = p->f + n * (size_t) i;
+    const float  z = NAN;
+
+    if (p->b == 32)
+    {
+        const float *e = (const float *) (p->o ? t : s);
+
+        if (p->o) swap32((uint32_t *) t, (const uint32_t *) s, n);
+
+        for (size_t j = 0; j < n; j++)
+            if (!normf(p, e[j], d + j)) d[j] = z;
+    }
+    else if (p->b == 16 && p->g)
+    {
+        const int16_t *e = (const int16_t *) (p->o ? t : s);
+
+        if (p->o) swap16((uint16_t *) t, (const uint16_t *) s, n);
+
+        for (size_t j = 0; j < n; j++)
+            if (!norms16(p, e[j], d + j)) d[j] = z;
+    }
+    else if (p->b == 16)
+    {
+        const uint16_t *e = (const uint16_t *) (p->o ? t : s);
+
+        if (p->o) swap16((uint16_t *) t, (const uint16_t *) s, n);
+
+        for (size_t j = 0; j < n; j++)
+            normu16(p, e[j], d + j);
+    }
+    else if (p->b == 8 && p->g)
+    {
+        const int8_t *e = (const int8_t *) s;
+
+        for (size_t j = 0; j < n; j++)
+            norms8(p, e[j], d + j);
+    }
+    else if (p->b == 8)
+    {
+        const uint8_t *e = (const uint8_t *) s;
+
+        for (size_t j = 0; j < n; j++)
+            normu8(p, e[j], d + j);
+    }
+}
+
+// Stage each level of image p, byte-swapping and normalizing its channels once
+// into a native float buffer, so that sampling need only load them. Levels are
+// staged from the finest while their buffers fit within the staging limit. The
+// normalization parameters must not change afterward. Return the level count.
+
+int img_stage(img *p)
+{
+    size_t m = stage;
+    int    n = 0;
+
+    for (img *q = p; q && p->norm1 != p->norm0; q = q->mip)
+    {
+        const size_t c = (size_t) q->w * (size_t) q->c;
+        const size_t k = (size_t) q->h * c * sizeof (float);
+
+        if (q->f == NULL && k <= m && (q->f = (float *) malloc(k)))
+        {
+            bool b = true;
+            int  i;
+
+            #pragma omp parallel reduction(&&:b)
+            {
+                void *t = malloc(c * sizeof (float));
+
+                #pragma omp for
+                for (i = 0; i < q->h; i++)
+                    if (t) stage_row(q, i, t);
+
+                b = (t != NULL);
+                free(t);
+            }
+
+            if (b)
+            {
+                m -= k;
+                n += 1;
+            }
+            else
+            {
+                free(q->f);
+                q->f = NULL;
+                break;
+            }
+        }
+        else break;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+
 // Perform a linearly-filtered sampling of the image p. The filter position
 // is smoothly-varying in the range [0, w), [0, h).
 
@@ -527,6 +931,611 @@ int img_sample(img *p, const double *v, float *c)
     return h;
 }
 
+// Texel fetch functions for pixel formats in which every value is valid.
+
+static inline float fetch_u8(const img *p, size_t s)
+{
+    float f;
+    normu8(p, ((const uint8_t *) p->p)[s], &f);
+    return f;
+}
+
+static inline float fetch_s8(const img *p, size_t s)
+{
+    float f;
+    norms8(p, ((const int8_t *) p->p)[s], &f);
+    return f;
+}
+
+static inline float fetch_u16(const img *p, size_t s)
+{
+    float f;
+    normu16(p, getuint16(p, (const uint16_t *) p->p + s), &f);
+    return f;
+}
+
+// Perform a linearly-filtered sampling of image p at t, as does img_linear,
+// using texel fetch function get. Where all four texels are in range, they
+// are read directly. Otherwise, fall back on img_linear.
+
+static inline int img_linear_fetch(img *p, const double *t, float *c,
+                                   float (*get)(const img *, size_t))
+{
+    double s = t[0] - 0.5;
+    double r = t[1] - 0.5;
+
+    const int ia = (int) floor(s);
+    const int ib = (int)  ceil(s);
+    const int ja = (int) floor(r);
+    const int jb = (int)  ceil(r);
+
+    if (0 <= ia && ib < p->h && 0 <= ja && jb < p->w)
+    {
+        const float u = (float) (s - floor(s));
+        const float v = (float) (r - floor(r));
+
+        const size_t aa = ((size_t) p->w * ia + ja) * (size_t) p->c;
+        const size_t ab = ((size_t) p->w * ia + jb) * (size_t) p->c;
+        const size_t ba = ((size_t) p->w * ib + ja) * (size_t) p->c;
+        const size_t bb = ((size_t) p->w * ib + jb) * (size_t) p->c;
+
+        for (int k = 0; k < p->c; k++)
+            c[k] = lerp2(get(p, aa + k), get(p, ab + k),
+                         get(p, ba + k), get(p, bb + k), u, v);
+        return 1;
+    }
+    return img_linear(p, t, c);
+}
+
+// Find the distance in pixels of image p between image location t and the
+// projections of longitude lon and latitude lat offset by d and e in each
+// direction, taking the nearer. This avoids the wrap of any projection. Return
+// zero if neither offset projects.
+
+static double img_offset(img *p, const double *v, double lon, double lat,
+                                 double d, double e, const double *t)
+{
+    double a[2];
+    double b[2];
+    double f = 0.0;
+
+    const int ha = p->project(p, v, lon + d, lat + e, a);
+    const int hb = p->project(p, v, lon - d, lat - e, b);
+
+    const double fa = hypot(a[0] - t[0], a[1] - t[1]);
+    const double fb = hypot(b[0] - t[0], b[1] - t[1]);
+
+    if (ha && hb) f = min(fa, fb);
+    else if  (ha) f = fa;
+    else if  (hb) f = fb;
+
+    return f;
+}
+
+// Select the level of the pyramid of image p whose pixels best match the size
+// of a sample of angular radius r at location t, projected from v at longitude
+// lon and latitude lat. Scale t to that level and return the level's image.
+
+static img *img_level(img *p, const double *v, double lon, double lat,
+                                               double r, double *t)
+{
+    const double d = r / max(cos(lat), r);
+
+    double f = max(img_offset(p, v, lon, lat, d, 0, t),
+                   img_offset(p, v, lon, lat, 0, r, t));
+
+    while (f >= 2.0 && p->mip)
+    {
+        p     = p->mip;
+        f    /= 2.0;
+        t[0] /= 2.0;
+        t[1] /= 2.0;
+    }
+    return p;
+}
+
+// Filter each of the m samples of image p at image location t that has its hit
+// flag set in H, reading from the image or pyramid level q. Store the result in
+// C and clear the hit flag of any sample that falls outside of the image.
+
+static void img_filter_n(img *p, int m, img **q, const double *t, float *C,
+                                                                  int   *H)
+{
+    int i;
+
+    if (p->b == 8 && p->g == 0)
+    {
+        for (i = 0; i < m; i++)
+            if (H[i]) H[i] = img_linear_fetch(q[i], t + 2 * i, C + p->c * i, fetch_u8);
+    }
+    else if (p->b == 8 && p->g == 1)
+    {
+        for (i = 0; i < m; i++)
+            if (H[i]) H[i] = img_linear_fetch(q[i], t + 2 * i, C + p->c * i, fetch_s8);
+    }
+    else if (p->b == 16 && p->g == 0)
+    {
+        for (i = 0; i < m; i++)
+            if (H[i]) H[i] = img_linear_fetch(q[i], t + 2 * i, C + p->c * i, fetch_u16);
+    }
+    else
+    {
+        for (i = 0; i < m; i++)
+            if (H[i]) H[i] = img_linear(q[i], t + 2 * i, C + p->c * i);
+    }
+}
+
+// Sample image p at each of the n vectors v, as would n calls to img_sample.
+// Store the p->c channels of each in c and its hit flag in h. Samples are
+// processed in batches, with the blending tests, projection, and pixel format
+// dispatch hoisted out of the per-sample loops. If r is nonzero and p has a
+// pyramid, filter each sample of angular radius r at the matching level.
+// Return the hit count.
+
+#define IMG_BATCH 64
+
+int img_sample_n(img *p, int n, const double *v, double r, float *c, int *h)
+{
+    const int blat = (p->latc || p->lat0 || p->lat1);
+    const int blon = (p->lonc || p->lon0 || p->lon1);
+
+    double lon[IMG_BATCH];
+    double lat[IMG_BATCH];
+    double t[IMG_BATCH * 2];
+    float  k[IMG_BATCH];
+    img   *q[IMG_BATCH];
+
+    int N = 0;
+
+    for (int i0 = 0; i0 < n; i0 += IMG_BATCH)
+    {
+        const int m = min(n - i0, IMG_BATCH);
+
+        const double *V = v + 3 * (size_t) i0;
+        float        *C = c + p->c * (size_t) i0;
+        int          *H = h + i0;
+
+        int i;
+
+        // Find the longitude, latitude, and blend weight of each sample.
+
+        for (i = 0; i < m; i++)
+        {
+            lon[i] = tolon(atan2(V[3 * i + 0], V[3 * i + 2]));
+            lat[i] =        asin(V[3 * i + 1]);
+        }
+        for (i = 0; i < m; i++)
+            k[i] = 1.f;
+
+        if (blat)
+            for (i = 0; i < m; i++)
+                k[i] *= (float) blend(p->lat0, p->lat1, angle(lat[i], p->latc));
+        if (blon)
+            for (i = 0; i < m; i++)
+                k[i] *= (float) blend(p->lon0, p->lon1, angle(lon[i], p->lonc));
+
+        // Project each weighted sample into the image.
+
+        for (i = 0; i < m; i++)
+            H[i] = k[i] ? p->project(p, V + 3 * i, lon[i], lat[i], t + 2 * i) : 0;
+
+        // Select the pyramid level of each sample.
+
+        if (r > 0.0 && p->mip)
+        {
+            for (i = 0; i < m; i++)
+                if (H[i])
+                    q[i] = img_level(p, V + 3 * i, lon[i], lat[i], r, t + 2 * i);
+        }
+        else
+        {
+            for (i = 0; i < m; i++)
+                q[i] = p;
+        }
+
+        // Filter each projected sample.
+
+        img_filter_n(p, m, q, t, C, H);
+
+        // Apply the blend weights.
+
+        if (blat || blon)
+            for (i = 0; i < m; i++)
+                if (H[i])
+                    for (int j = 0; j < p->c; j++)
+                        C[p->c * i + j] *= k[i];
+
+        for (i = 0; i < m; i++)
+            N += H[i];
+    }
+    return N;
+}
+
+//------------------------------------------------------------------------------
+
+// The approximate transform tolerance in image pixels. Zero disables it.
+
+static double approx = 0.0;
+
+void img_set_approx(double e)
+{
+    approx = e;
+}
+
+// Project vector v into image p exactly, as does img_sample, storing the image
+// location in t[0] and t[1], the blend weight in t[2], and the hit flag in t[3].
+
+static void img_project(img *p, const double *v, double *t)
+{
+    const double lon = tolon(atan2(v[0], v[2])), lat = asin(v[1]);
+
+    double k = 1.0;
+
+    if (p->latc || p->lat0 || p->lat1)
+        k *= blend(p->lat0, p->lat1, angle(lat, p->latc));
+    if (p->lonc || p->lon0 || p->lon1)
+        k *= blend(p->lon0, p->lon1, angle(lon, p->lonc));
+
+    t[2] = k;
+    t[3] = (k && p->project(p, v, lon, lat, t)) ? 1.0 : 0.0;
+}
+
+// Bilinearly interpolate the projections a, b, c, d of the corners of a grid
+// cell at row fraction u and column fraction v. The result hits only where all
+// four corners hit.
+
+static void img_grid_lerp(const double *a, const double *b,
+                          const double *c, const double *d,
+                          double u, double v, double *t)
+{
+    for (int k = 0; k < 3; k++)
+        t[k] = (a[k] * (1.0 - v) + b[k] * v) * (1.0 - u)
+             + (c[k] * (1.0 - v) + d[k] * v) * (      u);
+
+    t[3] = (a[3] && b[3] && c[3] && d[3]) ? 1.0 : 0.0;
+}
+
+// Refine the cell of grid G spanning rows i0 through i1 and columns j0 through
+// j1, the corners of which are projected exactly, as flagged in e. Project the
+// midpoints exactly. Where the interpolation of the corners misses any of them
+// by more than the tolerance, subdivide. Otherwise interpolate the interior. A
+// single cell that fails the test at its center is flagged for exact sampling.
+
+static void img_refine(img_grid *G, img *p, char *e, int i0, int j0,
+                                                     int i1, int j1)
+{
+    const int m = G->m + 1;
+
+    const double *a = G->t + 4 * ((size_t) m * i0 + j0);
+    const double *b = G->t + 4 * ((size_t) m * i0 + j1);
+    const double *c = G->t + 4 * ((size_t) m * i1 + j0);
+    const double *d = G->t + 4 * ((size_t) m * i1 + j1);
+
+    const int im = (i0 + i1) / 2;
+    const int jm = (j0 + j1) / 2;
+
+    const int I[3] = { i0, im, i1 };
+    const int J[3] = { j0, jm, j1 };
+
+    bool ok = (a[3] && b[3] && c[3] && d[3]);
+
+    double t[4];
+    double u[4];
+    double v[3];
+    int    i;
+    int    j;
+
+    if (i1 - i0 <= 1 && j1 - j0 <= 1)
+    {
+        if (ok)
+        {
+            mid4(v, G->g + 3 * ((size_t) m * i0 + j0),
+                    G->g + 3 * ((size_t) m * i0 + j1),
+                    G->g + 3 * ((size_t) m * i1 + j0),
+                    G->g + 3 * ((size_t) m * i1 + j1));
+
+            img_project(p, v, t);
+            img_grid_lerp(a, b, c, d, 0.5, 0.5, u);
+
+            ok = t[3] && fabs(t[0] - u[0]) <= approx
+                      && fabs(t[1] - u[1]) <= approx;
+        }
+        if (!ok) G->x[(size_t) G->m * i0 + j0] = 1;
+        return;
+    }
+
+    // Test the interpolation at the exact projection of each midpoint.
+
+    for     (int y = 0; y < 3; y++)
+        for (int x = 0; x < 3; x++)
+        {
+            const size_t k = (size_t) m * I[y] + J[x];
+
+            i = I[y];
+            j = J[x];
+
+            if (e[k] == 0)
+            {
+                img_project(p, G->g + 3 * k, G->t + 4 * k);
+                e[k] = 1;
+            }
+            if (ok)
+            {
+                img_grid_lerp(a, b, c, d, (double) (i - i0) / (i1 - i0),
+                                          (double) (j - j0) / (j1 - j0), t);
+
+                ok = G->t[4 * k + 3] && fabs(G->t[4 * k + 0] - t[0]) <= approx
+                                     && fabs(G->t[4 * k + 1] - t[1]) <= approx;
+            }
+        }
+
+    // Interpolate the interior or subdivide.
+
+    if (ok)
+    {
+        for     (i = i0; i <= i1; i++)
+            for (j = j0; j <= j1; j++)
+                if (e[(size_t) m * i + j] == 0)
+                    img_grid_lerp(a, b, c, d, (double) (i - i0) / (i1 - i0),
+                                              (double) (j - j0) / (j1 - j0),
+                                              G->t + 4 * ((size_t) m * i + j));
+    }
+    else
+    {
+        const int ia = (im > i0) ? im : i1;
+        const int ja = (jm > j0) ? jm : j1;
+
+        img_refine(G, p, e, i0, j0, ia, ja);
+
+        if (ja < j1)
+            img_refine(G, p, e, i0, ja, ia, j1);
+        if (ia < i1)
+            img_refine(G, p, e, ia, j0, i1, ja);
+        if (ia < i1 && ja < j1)
+            img_refine(G, p, e, ia, ja, i1, j1);
+    }
+}
+
+// Initialize an approximate transform of the n-by-m cell grid of sample vectors
+// g into image p. Project a sparse lattice of grid points exactly and refine
+// each lattice cell. Return false if the approximate transform is disabled.
+
+#define IMG_GRID 16
+
+bool img_grid_init(img_grid *G, img *p, int n, int m, const double *g)
+{
+    const size_t N = ((size_t) n + 1) * ((size_t) m + 1);
+
+    char *e = NULL;
+    int   i0, i1;
+    int   j0, j1;
+
+    memset(G, 0, sizeof (img_grid));
+
+    if (approx > 0.0)
+    {
+        G->n = n;
+        G->m = m;
+        G->g = g;
+
+        if ((G->t = (double *) malloc(N * 4 * sizeof (double))) &&
+            (G->x = (char   *) calloc((size_t) n * m, 1)) &&
+            (e    = (char   *) calloc(N, 1)))
+        {
+            for (i0 = 0; i0 <= n; i0 = (i0 < n) ? min(i0 + IMG_GRID, n) : n + 1)
+                for (j0 = 0; j0 <= m; j0 = (j0 < m) ? min(j0 + IMG_GRID, m) : m + 1)
+                {
+                    const size_t k = ((size_t) m + 1) * i0 + j0;
+
+                    img_project(p, g + 3 * k, G->t + 4 * k);
+                    e[k] = 1;
+                }
+
+            for (i0 = 0; i0 < n; i0 = i1)
+                for (j0 = 0, i1 = min(i0 + IMG_GRID, n); j0 < m; j0 = j1)
+                {
+                    j1 = min(j0 + IMG_GRID, m);
+                    img_refine(G, p, e, i0, j0, i1, j1);
+                }
+
+            free(e);
+            return true;
+        }
+        img_grid_free(G);
+    }
+    return false;
+}
+
+void img_grid_free(img_grid *G)
+{
+    free(G->x);
+    free(G->t);
+    memset(G, 0, sizeof (img_grid));
+}
+
+// Sample image p at each of the n locations s of grid G, given as fractional
+// row and column. Store the p->c channels of each in c and its hit flag in h,
+// as does img_sample_n. Interpolate the image location and blend weight of each
+// sample from the grid. Find the samples of flagged cells exactly, at vectors
+// interpolated from the grid, with pyramid filter radius r. Otherwise, filter
+// by pyramid level using the sample spacing d in grid cells. Return the hit
+// count.
+
+int img_sample_grid(img *p, const img_grid *G, int n, const double *s,
+                            double r, double d, float *c, int *h)
+{
+    const int bl = (p->latc || p->lat0 || p->lat1 ||
+                    p->lonc || p->lon0 || p->lon1);
+    const int m  = G->m + 1;
+
+    double t[IMG_BATCH * 2];
+    float  k[IMG_BATCH];
+    img   *q[IMG_BATCH];
+    double V[IMG_BATCH * 3];
+    float  D[IMG_BATCH * 4];
+    int    E[IMG_BATCH];
+    int    X[IMG_BATCH];
+
+    int N = 0;
+
+    for (int i0 = 0; i0 < n; i0 += IMG_BATCH)
+    {
+        const int M = min(n - i0, IMG_BATCH);
+
+        const double *S = s + 2 * (size_t) i0;
+        float        *C = c + p->c * (size_t) i0;
+        int          *H = h + i0;
+
+        int x = 0;
+        int i;
+
+        for (i = 0; i < M; i++)
+        {
+            const int ci = max(0, min((int) floor(S[2 * i + 0]), G->n - 1));
+            const int cj = max(0, min((int) floor(S[2 * i + 1]), G->m - 1));
+
+            const double u = S[2 * i + 0] - ci;
+            const double v = S[2 * i + 1] - cj;
+
+            const size_t o = (size_t) m * ci + cj;
+
+            const double *aa = G->t + 4 * (o);
+            const double *ab = G->t + 4 * (o + 1);
+            const double *ba = G->t + 4 * (o + m);
+            const double *bb = G->t + 4 * (o + m + 1);
+
+            double e[4];
+
+            if (G->x[(size_t) G->m * ci + cj])
+            {
+                // Gather the vector of an exact sample.
+
+                const double *ga = G->g + 3 * (o);
+                const double *gb = G->g + 3 * (o + 1);
+                const double *gc = G->g + 3 * (o + m);
+                const double *gd = G->g + 3 * (o + m + 1);
+
+                for (int l = 0; l < 3; l++)
+                    V[3 * x + l] = (ga[l] * (1.0 - v) + gb[l] * v) * (1.0 - u)
+                                 + (gc[l] * (1.0 - v) + gd[l] * v) * (      u);
+
+                normalize(V + 3 * x);
+                X[x++] = i;
+                H[i]   = 0;
+                continue;
+            }
+
+            img_grid_lerp(aa, ab, ba, bb, u, v, e);
+
+            t[2 * i + 0] = e[0];
+            t[2 * i + 1] = e[1];
+            k[i]         = (float) e[2];
+            H[i]         = (e[3] && k[i]) ? 1 : 0;
+            q[i]         = p;
+
+            // Select the pyramid level by the sample footprint in pixels.
+
+            if (H[i] && r > 0.0 && p->mip)
+            {
+                double f = d * max(hypot(ba[0] - aa[0], ba[1] - aa[1]),
+                                   hypot(ab[0] - aa[0], ab[1] - aa[1]));
+
+                while (f >= 2.0 && q[i]->mip)
+                {
+                    q[i]          = q[i]->mip;
+                    f            /= 2.0;
+                    t[2 * i + 0] /= 2.0;
+                    t[2 * i + 1] /= 2.0;
+                }
+            }
+        }
+
+        img_filter_n(p, M, q, t, C, H);
+
+        if (bl)
+            for (i = 0; i < M; i++)
+                if (H[i])
+                    for (int j = 0; j < p->c; j++)
+                        C[p->c * i + j] *= k[i];
+
+        // Sample the gathered vectors exactly and scatter the results.
+
+        if (x)
+        {
+            img_sample_n(p, x, V, r, D, E);
+
+            for (i = 0; i < x; i++)
+            {
+                H[X[i]] = E[i];
+                memcpy(C + p->c * X[i], D + p->c * i, p->c * sizeof (float));
+            }
+        }
+
+        for (i = 0; i < M; i++)
+            N += H[i];
+    }
+    return N;
+}
+
+// Find the range of image rows r[0] through r[1] hit by any of the n vectors
+// v. Return false if none hit.
+
+bool img_rows(img *p, int n, const double *v, int *r)
+{
+    bool b = false;
+
+    for (int i = 0; i < n; i++)
+    {
+        const double *u = v + 3 * i;
+        const double lon = tolon(atan2(u[0], u[2])), lat = asin(u[1]);
+
+        double t[2];
+
+        if (p->project(p, u, lon, lat, t) && 0 <= t[0] && t[0] < p->h)
+        {
+            const int k = (int) t[0];
+
+            if (b)
+            {
+                r[0] = min(r[0], k);
+                r[1] = max(r[1], k);
+            }
+            else
+            {
+                r[0] = k;
+                r[1] = k;
+                b    = true;
+            }
+        }
+    }
+    return b;
+}
+
+// Advise the system that rows r0 through r1 of a mapped image will be needed
+// soon, so that they may be paged in ahead of sampling.
+
+void img_prefetch(img *p, int r0, int r1)
+{
+#ifndef _WIN32
+    if (p->q)
+    {
+        const size_t z = (size_t) sysconf(_SC_PAGESIZE);
+
+        r0 = max(r0, 0);
+        r1 = min(r1, p->h - 1);
+
+        if (r0 <= r1)
+        {
+            const uintptr_t a = (uintptr_t) img_scanline(p, r0);
+            const uintptr_t b = (uintptr_t) img_scanline(p, r1 + 1);
+            const uintptr_t o = a - a % z;
+
+            posix_madvise((void *) o, (size_t) (b - o), POSIX_MADV_WILLNEED);
+        }
+    }
+#endif
+}
+
 int img_locate(img *p, const double *v)
 {
     const double lon = tolon(atan2(v[0], v[2])), lat = asin(v[1]);
@@ -544,4 +1553,103 @@ int img_locate(img *p, const double *v)
     return 0;
 }
 
+// Determine a latitude and longitude range containing every location found by
+// img_locate. E receives the minimum and maximum latitude and the western and
+// eastern longitude, where a longitude range of 2 pi or more is unbounded.
+// Return 2 if img_locate finds every location in the range, 1 if the range only
+// bounds them, or 0 if the projection does not give its extent.
+
+int img_extent(img *p, double *E)
+{
+    double a;
+    double b;
+
+    if (p->project == img_default)
+    {
+        E[0] = p->minimum_latitude;
+        E[1] = p->maximum_latitude;
+        E[2] = p->westernmost_longitude;
+        E[3] = p->easternmost_longitude;
+        return (E[1] > E[0] && E[3] > E[2]) ? 2 : 0;
+    }
+    if (p->project == img_orthographic)
+    {
+        E[0] = p->minimum_latitude;
+        E[1] = p->maximum_latitude;
+        E[2] = p->westernmost_longitude;
+        E[3] = p->easternmost_longitude;
+        return (E[1] > E[0] && E[3] > E[2]) ? 1 : 0;
+    }
+    if (p->project == img_equirectangular)
+    {
+        const double k = p->a_axis_radius * cos(p->center_latitude);
+
+        if (k > 0.0 && p->a_axis_radius > 0.0)
+        {
+            a = (p->line_projection_offset - p->h) * p->map_scale / p->a_axis_radius;
+            b = (p->line_projection_offset       ) * p->map_scale / p->a_axis_radius;
+
+            E[0] = min(a, b);
+            E[1] = max(a, b);
+
+            a = p->center_longitude + (       - p->sample_projection_offset) * p->map_scale / k;
+            b = p->center_longitude + (p->w - p->sample_projection_offset) * p->map_scale / k;
+
+            E[2] = max(min(a, b), 0.0);
+            E[3] = min(max(a, b), 2.0 * M_PI);
+            return (E[3] > E[2]) ? 2 : 0;
+        }
+        return 0;
+    }
+    if (p->project == img_simple_cylindrical)
+    {
+        if (p->map_resolution != 0.0)
+        {
+            a = todeg(p->center_latitude) + (p->line_projection_offset - 1 - p->h) / p->map_resolution;
+            b = todeg(p->center_latitude) + (p->line_projection_offset - 1       ) / p->map_resolution;
+
+            E[0] = min(a, b) * M_PI / 180.0;
+            E[1] = max(a, b) * M_PI / 180.0;
+
+            a = todeg(p->center_longitude) + (1        - p->sample_projection_offset) / p->map_resolution;
+            b = todeg(p->center_longitude) + (1 + p->w - p->sample_projection_offset) / p->map_resolution;
+
+            E[2] = max(min(a, b) * M_PI / 180.0, 0.0);
+            E[3] = min(max(a, b) * M_PI / 180.0, 2.0 * M_PI);
+            return (E[3] > E[2]) ? 2 : 0;
+        }
+        return 0;
+    }
+    if (p->project == img_polar_stereographic)
+    {
+        // Find the greatest distance from the pole to any corner of the image.
+
+        const double c = p->h / 2.0 - 1.5;
+        const double y = max(c, p->h - c);
+        const double x = max(c, p->w - c);
+
+        if (p->a_axis_radius > 0.0)
+        {
+            a = 2.0 * atan(fabs(p->map_scale) * sqrt(x * x + y * y)
+                                              / (2.0 * p->a_axis_radius));
+
+            if (p->center_latitude > 0)
+            {
+                E[0] =  M_PI / 2.0 - a;
+                E[1] =  M_PI / 2.0;
+            }
+            else
+            {
+                E[0] = -M_PI / 2.0;
+                E[1] = -M_PI / 2.0 + a;
+            }
+            E[2] = 0.0;
+            E[3] = 2.0 * M_PI;
+            return 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
 //------------------------------------------------------------------------------
@@ -13,6 +13,7 @@
 #ifndef SCMTIFF_IMG_H
 #define SCMTIFF_IMG_H
 
+#include <stdbool.h>
 #include "config.h"
 
 //------------------------------------------------------------------------------
@@ -70,26 +71,63 @@ struct img
     double lonc, lon0, lon1;
 
     int (*project)(img *, const double *, double, double, double *);
+
+    // Pyramid parameters
+
+    img *mip;  // Next coarser level, if any
+
+    // Staging parameters
+
+    float *f;  // Normalized native channel buffer, NaN where null, if any
 };
 
+// An approximate transform gives the image location of each point of a grid
+// of sample vectors, projected exactly on a sparse lattice and interpolated
+// elsewhere, with the cells flagged where interpolation is not accurate.
+
+typedef struct
+{
+    int           n;  // Grid row count, in cells
+    int           m;  // Grid column count, in cells
+    const double *g;  // Grid point vectors
+    double       *t;  // Grid point image row, column, blend weight, and hit
+    char         *x;  // Grid cell exact sampling flags
+} img_grid;
+
 //------------------------------------------------------------------------------
 
-img *jpg_load(const char *);
+img *jpg_load(const char *, int, int);
 img *png_load(const char *);
-img *tif_load(const char *);
+img *tif_load(const char *, int);
 img *pds_load(const char *);
 
 img *img_alloc(int, int, int, int, int);
 void img_close(img *);
 
 void img_set_defaults(img *);
+void img_set_budget(size_t);
+size_t img_get_budget(void);
+void img_set_approx(double);
+void img_set_stage(size_t);
+size_t img_get_stage(void);
 
 //------------------------------------------------------------------------------
 
 int   img_pixel   (img *, int, int, float *);
 void *img_scanline(img *, int);
 int   img_sample  (img *, const double *, float *);
+int   img_sample_n(img *, int, const double *, double, float *, int *);
 int   img_locate  (img *, const double *);
+bool  img_rows    (img *, int, const double *, int *);
+void  img_prefetch(img *, int, int);
+int   img_extent  (img *, double *);
+int   img_pyramid (img *);
+int   img_stage   (img *);
+
+bool  img_grid_init  (img_grid *, img *, int, int, const double *);
+void  img_grid_free  (img_grid *);
+int   img_sample_grid(img *, const img_grid *, int, const double *,
+                                               double, double, float *, int *);
 
 int   img_equirectangular (img *, const double *, double, double, double *);
 int   img_orthographic    (img *, const double *, double, double, double *);
@@ -20,7 +20,11 @@
 
 //------------------------------------------------------------------------------
 
-img *jpg_load(const char *name)
+// Load the named JPEG. If a minimum size w by h is given, decode at the
+// smallest scale of 1/8, 1/4, or 1/2 that still meets it, letting libjpeg
+// downsample in the DCT domain rather than decoding every pixel.
+
+img *jpg_load(const char *name, int w, int h)
 {
     img     *p = NULL;
     FILE    *s = NULL;
@@ -36,6 +40,19 @@ img *jpg_load(const char *name)
         jpeg_create_decompress(&cinfo);
         jpeg_stdio_src        (&cinfo, s);
         jpeg_read_header      (&cinfo, TRUE);
+
+        if (w > 0 && h > 0)
+        {
+            unsigned int k = 1;
+
+            while (k < 8 && ((cinfo.image_width  * k + 7) / 8 < (unsigned int) w ||
+                             (cinfo.image_height * k + 7) / 8 < (unsigned int) h))
+                k *= 2;
+
+            cinfo.scale_num   = k;
+            cinfo.scale_denom = 8;
+        }
+
         jpeg_start_decompress (&cinfo);
 
         if ((p = img_alloc((int) cinfo.output_width,
@@ -95,11 +95,32 @@ static void box(float *p, int ki, int kj, int c, int n, int O, float *q)
 
 //------------------------------------------------------------------------------
 
+// Determine whether page x is absent from SCM s but has a child present.
+
+static bool gap(scm *s, long long x)
+{
+    long long xv[4];
+
+    scm_page_children(x, xv);
+
+    return scm_search(s, x) < 0 && (scm_search(s, xv[0]) >= 0 ||
+                                    scm_search(s, xv[1]) >= 0 ||
+                                    scm_search(s, xv[2]) >= 0 ||
+                                    scm_search(s, xv[3]) >= 0);
+}
+
+// The children of consecutive pages are calculated in slices of this many.
+
+#define SLICE 256
+
 // Scan SCM s seeking any page that is not present, but which has at least one
 // child present. Fill such pages using down-sampled child data and append them.
-// Return the number of pages added, so we can stop when there are none.
+// Return the number of pages added, so we can stop when there are none. Only
+// pages above the first present are sought, unless resuming with u, in which
+// case an interruption may have left absent pages at any level. Then fill only
+// the deepest level with gaps, as the levels above it depend upon it.
 
-static long long process(scm *s, int O, int A)
+static long long process(scm *s, int O, int A, int u)
 {
     long long t = 0;
 
@@ -121,14 +142,47 @@ static long long process(scm *s, int O, int A)
 
         if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(s)))
         {
-            for (long long x = 0; x < scm_get_index(s, 0); ++x)
+            long long a = 0;
+            long long e = scm_get_index(s, 0);
+
+            if (u)
+            {
+                e = (scm_get_index(s, l - 1) < 6) ? 0 :
+                     scm_page_parent(scm_get_index(s, l - 1)) + 1;
+
+                while (e > 0 && !gap(s, e - 1))
+                    e--;
+                if (e > 0)
+                    a = scm_page_index(0, scm_page_level(e - 1), 0, 0);
+            }
+
+            long long xv[SLICE];
+            long long cv[SLICE * 4];
+
+            for (long long x = a; x < e; ++x)
             {
-                // Calculate the page indices for all children of x.
+                const long long k = (x - a) % SLICE;
+
+                // Calculate the page indices for all children of the slice of
+                // pages beginning with x.
+
+                if (k == 0)
+                {
+                    const long long m = min(SLICE, e - x);
 
-                long long x0 = scm_page_child(x, 0);
-                long long x1 = scm_page_child(x, 1);
-                long long x2 = scm_page_child(x, 2);
-                long long x3 = scm_page_child(x, 3);
+                    for (long long j = 0; j < m; ++j)
+                        xv[j] = x + j;
+
+                    scm_page_children_n(m, xv, cv);
+                }
+
+                if (u && scm_search(s, x) >= 0)
+                    continue;
+
+                long long x0 = cv[k * 4 + 0];
+                long long x1 = cv[k * 4 + 1];
+                long long x2 = cv[k * 4 + 2];
+                long long x3 = cv[k * 4 + 3];
 
                 // Seek the catalog location of each page index.
 
@@ -161,8 +215,10 @@ static long long process(scm *s, int O, int A)
 
                     if (A) grow(p, q, c, n);
 
-                    b = scm_append(s, b, x, p);
-                    t++;
+                    if ((b = scm_append(s, b, x, p)))
+                        t++;
+                    else
+                        break;
                 }
             }
             free(q);
@@ -174,7 +230,7 @@ static long long process(scm *s, int O, int A)
 
 //------------------------------------------------------------------------------
 
-int mipmap(int argc, char **argv, const char *o, const char *m, int A)
+int mipmap(int argc, char **argv, const char *o, const char *m, int A, int u)
 {
     int O = 2;
 
@@ -193,8 +249,12 @@ int mipmap(int argc, char **argv, const char *o, const char *m, int A)
         {
             long long c;
 
-            while ((c = process(s, O, A)))
-                ;
+            // Pages are appended in place, so resuming need only discard any
+            // page torn by the interruption before filling the gaps it left.
+
+            if (u == 0 || scm_recover(s) >= 0)
+                while ((c = process(s, O, A, u)))
+                    ;
 
             scm_close(s);
         }
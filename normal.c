@@ -46,24 +46,22 @@ static void facenorm(const double *a, const double *b, const double *c, double *
 
 // Generate normal vectors in buffer q using elevation values in buffer p.
 // i and j give the pixel location in the c-channel n-by-n input image.
-// u and v give the page location in the w-by-w subdivision of root face f.
+// g gives the sample center grid of the page, including its border.
 
-static void sampnorm(int f, int i, int j, int n, int c,
-                     long u, long v, long w, const float *r, const float *p, float *q)
+static void sampnorm(int i, int j, int n, int c, const double *g,
+                     const float *r, const float *p, float *q)
 {
     const float dr = r[1] - r[0];
 
-    double vn[3];
-    double vs[3];
-    double ve[3];
-    double vw[3];
-    double vc[3];
+    const double *g0 = g + 3 * ((n + 2) * (i + 0) + (j + 1));
+    const double *g1 = g + 3 * ((n + 2) * (i + 1) + (j + 0));
+    const double *g2 = g + 3 * ((n + 2) * (i + 2) + (j + 1));
 
-    scm_get_sample_center(f, n * u + i,     n * v + j,     n * w, vc);
-    scm_get_sample_center(f, n * u + i - 1, n * v + j,     n * w, vn);
-    scm_get_sample_center(f, n * u + i + 1, n * v + j,     n * w, vs);
-    scm_get_sample_center(f, n * u + i,     n * v + j - 1, n * w, ve);
-    scm_get_sample_center(f, n * u + i,     n * v + j + 1, n * w, vw);
+    double vn[3] = { g0[0], g0[1], g0[2] };
+    double vs[3] = { g2[0], g2[1], g2[2] };
+    double ve[3] = { g1[0], g1[1], g1[2] };
+    double vc[3] = { g1[3], g1[4], g1[5] };
+    double vw[3] = { g1[6], g1[7], g1[8] };
 
     double rc = p[((n + 2) * (i + 1) + (j + 1)) * c] * dr + r[0];
     double rn = p[((n + 2) * (i + 0) + (j + 1)) * c] * dr + r[0];
@@ -107,7 +105,7 @@ static void sampnorm(int f, int i, int j, int n, int c,
 static long long divide(scm *s, long long x,
                         scm *t, long long b,
                         long u, long v, long w,
-                        const float *r, float *p, float *q)
+                        const float *r, float *p, float *q, double *g)
 {
     long long i;
 
@@ -125,28 +123,34 @@ static long long divide(scm *s, long long x,
             int i;
             int j;
 
+            scm_get_page_centers(f, u, v, w, n, g);
+
             #pragma omp parallel for private(j)
             for     (i = 0; i < n; ++i)
                 for (j = 0; j < n; ++j)
-                    sampnorm(f, i, j, n, c, u, v, w, r, p, q);
+                    sampnorm(i, j, n, c, g, r, p, q);
 
             b = scm_append(t, b, x, q);
         }
 
         // Generate normal maps for the children of page x.
 
-        long long x0 = scm_page_child(x, 0);
-        long long x1 = scm_page_child(x, 1);
-        long long x2 = scm_page_child(x, 2);
-        long long x3 = scm_page_child(x, 3);
+        long long xv[4];
+
+        scm_page_children(x, xv);
+
+        long long x0 = xv[0];
+        long long x1 = xv[1];
+        long long x2 = xv[2];
+        long long x3 = xv[3];
 
         long u0 = u * 2, u1 = u0 + 1;
         long v0 = v * 2, v1 = v0 + 1;
 
-        if (x0) b = divide(s, x0, t, b, u0, v0, 2 * w, r, p, q);
-        if (x1) b = divide(s, x1, t, b, u0, v1, 2 * w, r, p, q);
-        if (x2) b = divide(s, x2, t, b, u1, v0, 2 * w, r, p, q);
-        if (x3) b = divide(s, x3, t, b, u1, v1, 2 * w, r, p, q);
+        if (x0) b = divide(s, x0, t, b, u0, v0, 2 * w, r, p, q, g);
+        if (x1) b = divide(s, x1, t, b, u0, v1, 2 * w, r, p, q, g);
+        if (x2) b = divide(s, x2, t, b, u1, v0, 2 * w, r, p, q, g);
+        if (x3) b = divide(s, x3, t, b, u1, v1, 2 * w, r, p, q, g);
     }
     return b;
 }
@@ -156,25 +160,30 @@ static long long divide(scm *s, long long x,
 
 static void process(scm *s, scm *t, const float *r)
 {
-    float *p;
-    float *q;
+    const size_t m = (size_t) scm_get_n(s) + 2;
+
+    double *g;
+    float  *p;
+    float  *q;
 
     if (scm_scan_catalog(s))
     {
-        if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(t)))
+        if ((p = scm_alloc_buffer(s)) && (q = scm_alloc_buffer(t)) &&
+            (g = (double *) malloc(m * m * 3 * sizeof (double))))
         {
             long long b = 0;
 
             memset(q, 0, 3 * (size_t) (scm_get_n(t) + 2) *
                              (size_t) (scm_get_n(t) + 2) * sizeof (float));
 
-            b = divide(s, 0, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 1, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 2, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 3, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 4, t, b, 0, 0, 1, r, p, q);
-            b = divide(s, 5, t, b, 0, 0, 1, r, p, q);
+            b = divide(s, 0, t, b, 0, 0, 1, r, p, q, g);
+            b = divide(s, 1, t, b, 0, 0, 1, r, p, q, g);
+            b = divide(s, 2, t, b, 0, 0, 1, r, p, q, g);
+            b = divide(s, 3, t, b, 0, 0, 1, r, p, q, g);
+            b = divide(s, 4, t, b, 0, 0, 1, r, p, q, g);
+            b = divide(s, 5, t, b, 0, 0, 1, r, p, q, g);
 
+            free(g);
             free(q);
             free(p);
         }
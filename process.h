@@ -16,17 +16,22 @@
 //------------------------------------------------------------------------------
 
 int sample (int, char **, const float *, int);
+int visible(int, char **, const float *);
 int normal (int, char **, const char *, const float *);
 int finish (int, char **, const char *, int);
 int polish (int, char **);
-int border (int, char **, const char *);
-int mipmap (int, char **, const char *, const char *, int);
+int border (int, char **, const char *, int);
+int mipmap (int, char **, const char *, const char *, int, int);
 int combine(int, char **, const char *, const char *);
 int rectify(int, char **, const char *, int,
            const float *, const double *, const double *, const double *);
-int convert(int, char **, const char *, int, int, int, int, int,
-           const float *, const double *, const double *, const double *);
+int convert(int, char **, const char *, const char *, const char *,
+           const char *, int, int, int, int, int, int, int, int, int,
+           const float *, const double *, const double *, const double *,
+           const double *);
 int extrema(int, char **);
+int collect(int, char **, const char *);
+int reorder(int, char **, const char *, const char *, const char *, int);
 
 //------------------------------------------------------------------------------
 
@@ -32,80 +32,136 @@ static double lerp(double a, double b, double t)
     return b * t + a * (1.0 - t);
 }
 
-// Sample the image at the given latitude and longitude. If it's a hit, add
-// the value to the pixel at b.
+// Find the sample vector at the given latitude and longitude.
 
-static int accumulate(img *p, double lat, double lon, float *b, int c)
+static void vector(double lat, double lon, double *v)
 {
-    double v[3];
-    float  t[4];
-
     v[0] = sin(lon) * cos(lat);
     v[1] =            sin(lat);
     v[2] = cos(lon) * cos(lat);
+}
+
+// Perform a quincunx multisampling of the image at each pixel of row i in the
+// given range of latitude and longitude. Find the five sample vectors of every
+// pixel of the row and sample them all at once, or given an approximate
+// transform G of the tile's pixel corners, sample them by grid position. This
+// function forms the kernel of an OpenMP parallelization of the sampling of an
+// entire TIFF tile.
+
+static void dorow(img *p, double lat0, double lat1,
+                          double lon0, double lon1,
+                          const img_grid *G,
+                          float *b, int i, int s, int c)
+{
+    double *V = (double *) malloc((size_t) s * 15 * sizeof (double));
+    float  *T = (float  *) malloc((size_t) s *  5 * c * sizeof (float));
+    int    *H = (int    *) malloc((size_t) s *  5 * sizeof (int));
 
-    if (img_sample(p, v, t))
+    if (V && T && H && G)
     {
-        switch (c)
+        for (int j = 0; j < s; ++j)
         {
-            case 4: b[3] += t[3];
-            case 3: b[2] += t[2];
-            case 2: b[1] += t[1];
-            case 1: b[0] += t[0];
+            double *S = V + 10 * j;
+
+            S[0] = i + 0.25; S[1] = j + 0.25;
+            S[2] = i + 0.25; S[3] = j + 0.75;
+            S[4] = i + 0.50; S[5] = j + 0.50;
+            S[6] = i + 0.75; S[7] = j + 0.25;
+            S[8] = i + 0.75; S[9] = j + 0.75;
         }
-        return 1;
+
+        img_sample_grid(p, G, 5 * s, V, 0.0, 0.0, T, H);
     }
-    return 0;
-}
+    else if (V && T && H)
+    {
+        double i0 = lerp(lat0, lat1, ((float) i + 0.25) / s);
+        double i1 = lerp(lat0, lat1, ((float) i + 0.50) / s);
+        double i2 = lerp(lat0, lat1, ((float) i + 0.75) / s);
 
-// Perform a quincunx multisampling of the image at pixel (i, j) in the given
-// range of latitude and longitude. This function forms the kernel of an OpenMP
-// parallelization of the sampling of an entire TIFF tile.
+        for (int j = 0; j < s; ++j)
+        {
+            double j0 = lerp(lon0, lon1, ((float) j + 0.25) / s);
+            double j1 = lerp(lon0, lon1, ((float) j + 0.50) / s);
+            double j2 = lerp(lon0, lon1, ((float) j + 0.75) / s);
+
+            vector(i0, j0, V + 15 * j +  0);
+            vector(i0, j2, V + 15 * j +  3);
+            vector(i1, j1, V + 15 * j +  6);
+            vector(i2, j0, V + 15 * j +  9);
+            vector(i2, j2, V + 15 * j + 12);
+        }
 
-static void dosamp(img *p, double lat0, double lat1,
-                           double lon0, double lon1,
-                           float *b, int i, int j, int s, int c)
-{
-    double i0 = lerp(lat0, lat1, ((float) i + 0.25) / s);
-    double i1 = lerp(lat0, lat1, ((float) i + 0.50) / s);
-    double i2 = lerp(lat0, lat1, ((float) i + 0.75) / s);
+        img_sample_n(p, 5 * s, V, 0.0, T, H);
+    }
 
-    double j0 = lerp(lon0, lon1, ((float) j + 0.25) / s);
-    double j1 = lerp(lon0, lon1, ((float) j + 0.50) / s);
-    double j2 = lerp(lon0, lon1, ((float) j + 0.75) / s);
+    if (V && T && H)
+    {
+        for (int j = 0; j < s; ++j)
+        {
+            float *q = b + c * (i * s + j);
+            int    d = 0;
 
-    float *q = b + c * (i * s + j);
+            for (int l = 0; l < 5; l++)
+            {
+                const float *t = T + c * (5 * j + l);
 
-    int d = accumulate(p, i0, j0, q, c) +
-            accumulate(p, i0, j2, q, c) +
-            accumulate(p, i1, j1, q, c) +
-            accumulate(p, i2, j0, q, c) +
-            accumulate(p, i2, j2, q, c);
+                if (H[5 * j + l])
+                {
+                    switch (c)
+                    {
+                        case 4: q[3] += t[3];
+                        case 3: q[2] += t[2];
+                        case 2: q[1] += t[1];
+                        case 1: q[0] += t[0];
+                    }
+                    d++;
+                }
+            }
 
-    if (d)
-        switch (c)
-        {
-            case 4: q[3] /= d;
-            case 3: q[2] /= d;
-            case 2: q[1] /= d;
-            case 1: q[0] /= d;
+            if (d)
+                switch (c)
+                {
+                    case 4: q[3] /= d;
+                    case 3: q[2] /= d;
+                    case 2: q[1] /= d;
+                    case 1: q[0] /= d;
+                }
         }
+    }
+    free(H);
+    free(T);
+    free(V);
 }
 
 // Sample the image across an entire TIFF tile covering the given range of
-// latitude and longitude.
+// latitude and longitude. If enabled, approximate the transform of the grid of
+// pixel corners.
 
 static void dotile(img *p, double lat0, double lat1,
                            double lon0, double lon1,
                            float *b, int s, int c)
 {
-    int i;
-    int j;
+    double  *g = (double *) malloc((size_t) (s + 1) * (s + 1) * 3 * sizeof (double));
+    img_grid G;
+    bool     A = false;
+    int      i;
+
+    if (g)
+    {
+        for     (i = 0; i <= s; ++i)
+            for (int j = 0; j <= s; ++j)
+                vector(lerp(lat0, lat1, (double) i / s),
+                       lerp(lon0, lon1, (double) j / s), g + 3 * ((s + 1) * i + j));
+
+        A = img_grid_init(&G, p, s, s, g);
+    }
+
+    #pragma omp parallel for
+    for (i = 0; i < s; ++i)
+        dorow(p, lat0, lat1, lon0, lon1, A ? &G : NULL, b, i, s, c);
 
-    #pragma omp parallel for private(j)
-    for     (i = 0; i < s; ++i)
-        for (j = 0; j < s; ++j)
-            dosamp(p, lat0, lat1, lon0, lon1, b, i, j, s, c);
+    if (A) img_grid_free(&G);
+    free(g);
 }
 
 // Sample the image across the entire sphere, storing the results to a tiled
@@ -186,9 +242,9 @@ int rectify(int argc, char **argv, const char *o,
 
         // Load the input file.
 
-        if      (extcmp(in, ".jpg") == 0) p = jpg_load(in);
+        if      (extcmp(in, ".jpg") == 0) p = jpg_load(in, 0, 0);
         else if (extcmp(in, ".png") == 0) p = png_load(in);
-        else if (extcmp(in, ".tif") == 0) p = tif_load(in);
+        else if (extcmp(in, ".tif") == 0) p = tif_load(in, 0);
         else if (extcmp(in, ".img") == 0) p = pds_load(in);
         else if (extcmp(in, ".lbl") == 0) p = pds_load(in);
 
@@ -232,8 +288,9 @@ int rectify(int argc, char **argv, const char *o,
                 p->norm1 = 1.0f;
             }
 
-            // Process the output.
+            // Stage the normalized channels and process the output.
 
+            img_stage(p);
             process(out, p, n, 256, p->c);
             img_close(p);
         }
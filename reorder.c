@@ -0,0 +1,135 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scm.h"
+#include "scmdef.h"
+#include "err.h"
+#include "util.h"
+#include "process.h"
+
+//------------------------------------------------------------------------------
+
+typedef struct { long long k; long long i; } order;
+
+// Standard-library-compatible compare function for page order keys.
+
+static int kcompare(const void *p, const void *q)
+{
+    const order *a = (const order *) p;
+    const order *b = (const order *) q;
+
+    if      (a->k < b->k) return -1;
+    else if (a->k > b->k) return +1;
+    else                  return  0;
+}
+
+// Calculate the Z-order key of page x. Keys of one level follow those of the
+// level above, and keys of one root follow those of the root before, but the
+// row and column bits of x are interleaved, so the four children of any page
+// are adjacent.
+
+static long long zkey(long long x)
+{
+    long long f, l, r, c, z = 0;
+
+    scm_page_decode(x, &f, &l, &r, &c);
+
+    for (long long k = 0; k < l; k++)
+        z |= (((r >> k) & 1) << (2 * k + 1))
+          |  (((c >> k) & 1) << (2 * k));
+
+    return scm_page_index(f, l, 0, 0) + z;
+}
+
+// Copy all pages of SCM s to SCM t in the order given by O, reserving space
+// at the head of t to receive the metadata written by finishing it.
+
+static void process(scm *s, scm *t, const char *O, const char *txt, int l)
+{
+    const long long n = scm_get_length(s);
+
+    order *v;
+
+    if ((v = (order *) malloc((size_t) n * sizeof (order))))
+    {
+        const int z = (O && strcmp(O, "z") == 0);
+
+        long long b = 0;
+        long long i;
+
+        for (i = 0; i < n; i++)
+        {
+            v[i].k = z ? zkey(scm_get_index(s, i)) : scm_get_index(s, i);
+            v[i].i = i;
+        }
+
+        if (z) qsort(v, (size_t) n, sizeof (order), kcompare);
+
+        if (scm_reserve(t, scm_finish_size(s, txt, l)))
+        {
+            for (i = 0; i < n; i++)
+                if ((b = scm_repeat(t, b, s, scm_get_offset(s, v[i].i))) == 0)
+                {
+                    apperr("Failed to copy page %lld", scm_get_index(s, v[i].i));
+                    break;
+                }
+
+            if (i == n)
+                scm_finish(t, txt, l);
+        }
+        free(v);
+    }
+}
+
+int reorder(int argc, char **argv, const char *o,
+                                   const char *m,
+                                   const char *t, int l)
+{
+    if (argc > 0)
+    {
+        const char *out = o ? o : "out.tif";
+        char       *txt = NULL;
+
+        scm *s;
+        scm *u;
+
+        if (t)
+            txt = load_txt(t);
+
+        if (txt == NULL)
+            txt = "Copyright (c) 2012 Robert Kooima";
+
+        if (m && strcmp(m, "index") && strcmp(m, "z"))
+            apperr("Unknown reorder mode '%s'", m);
+
+        else if ((s = scm_ifile(argv[0])))
+        {
+            if (scm_scan_catalog(s))
+            {
+                if ((u = scm_ofile(out, scm_get_n(s), scm_get_c(s),
+                                        scm_get_b(s), scm_get_g(s))))
+                {
+                    process(s, u, m, txt, l);
+                    scm_close(u);
+                }
+            }
+            scm_close(s);
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
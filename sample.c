@@ -30,10 +30,14 @@ static bool traverse(scm *s, double a, double b, long long x, int d,
     {
         if (d > 0)
         {
-            long long x0 = scm_page_child(x, 0);
-            long long x1 = scm_page_child(x, 1);
-            long long x2 = scm_page_child(x, 2);
-            long long x3 = scm_page_child(x, 3);
+            long long xv[4];
+
+            scm_page_children(x, xv);
+
+            long long x0 = xv[0];
+            long long x1 = xv[1];
+            long long x2 = xv[2];
+            long long x3 = xv[3];
 
             double a0 = 2.0 * (a - 0.0);
             double a1 = 2.0 * (a - 0.5);
@@ -18,15 +18,31 @@
 #include <float.h>
 #include <math.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "scmdef.h"
 #include "scmdat.h"
 #include "scmio.h"
+#include "scmocc.h"
 #include "scm.h"
 #include "err.h"
 #include "util.h"
 
 //------------------------------------------------------------------------------
 
+// The codec selection policy given to newly-opened output files.
+
+static int codec = SCM_CODEC_FIXED;
+
+void scm_set_codec(int z)
+{
+    codec = z;
+}
+
+//------------------------------------------------------------------------------
+
 // Release all resources associated with SCM s. This function may be used to
 // clean up after an error during initialization, and does not assume that the
 // structure is fully populated.
@@ -35,16 +51,123 @@ void scm_close(scm *s)
 {
     if (s)
     {
+        if (s->z)
+            scm_report(s);
         if (s->fp)
             fclose(s->fp);
+        for (int k = 0; k < s->sc; k++)
+            scm_close(s->sv[k]);
         scm_free(s);
+        scm_occ_free(&s->xq);
+        scm_occ_free(&s->yq);
+        free(s->sv);
+        free(s->yv);
+        free(s->av);
+        free(s->zv);
+        free(s->xv);
+        free(s->ov);
         free(s->name);
         free(s);
     }
 }
 
+// Determine whether the file at fp is an SCM collection manifest.
+
+static bool ismanifest(FILE *fp)
+{
+    char str[sizeof (SCM_MANIFEST)];
+
+    size_t n = fread(str, 1, sizeof (SCM_MANIFEST) - 1, fp);
+
+    rewind(fp);
+
+    return (n == sizeof (SCM_MANIFEST) - 1 &&
+            strncmp(str, SCM_MANIFEST, n) == 0);
+}
+
+// Read the manifest of collection s and open each listed shard. Shard names
+// are relative to the directory of the manifest. All shards must share the
+// same page parameters, which become the parameters of the collection.
+
+static bool scm_read_manifest(scm *s)
+{
+    char dir[256];
+    char str[256];
+    char path[512];
+
+    dircpy(dir, s->name);
+
+    if (fgets(str, sizeof (str), s->fp) == NULL)
+        return false;
+
+    while (fgets(str, sizeof (str), s->fp))
+    {
+        size_t l = strlen(str);
+        scm   *t;
+        scm  **v;
+
+        while (l && (str[l - 1] == '\n' || str[l - 1] == '\r' ||
+                     str[l - 1] == ' '  || str[l - 1] == '\t'))
+            str[--l] = 0;
+
+        if (l == 0)
+            continue;
+
+        if (str[0] == '/')
+            strcpy(path, str);
+        else
+            sprintf(path, "%s%s", dir, str);
+
+        if ((t = scm_ifile(path)) == NULL)
+            return false;
+
+        if (t->sv)
+        {
+            apperr("%s: Collection shard %s is a collection", s->name, path);
+            scm_close(t);
+            return false;
+        }
+        if (s->sc && (s->n != t->n || s->c != t->c ||
+                      s->b != t->b || s->g != t->g || s->r != t->r))
+        {
+            apperr("%s: Collection shard %s has mismatched parameters",
+                   s->name, path);
+            scm_close(t);
+            return false;
+        }
+        if (s->sc == 1 << (64 - SCM_SHARD_SHIFT - 1))
+        {
+            apperr("%s: Too many collection shards", s->name);
+            scm_close(t);
+            return false;
+        }
+        if ((v = (scm **) realloc(s->sv, (size_t) (s->sc + 1) * sizeof (scm *))))
+        {
+            s->sv = v;
+            s->sv[s->sc++] = t;
+
+            s->n = t->n;
+            s->c = t->c;
+            s->b = t->b;
+            s->g = t->g;
+            s->r = t->r;
+        }
+        else
+        {
+            scm_close(t);
+            return false;
+        }
+    }
+
+    if (s->sc == 0)
+        apperr("%s: SCM collection lists no shards", s->name);
+
+    return (s->sc > 0);
+}
+
 // Open an SCM TIFF input file. Validate the header. Read and validate the first
 // IFD. Initialize and return an SCM structure using the first IFD's parameters.
+// If the file is a collection manifest, open all of its shards instead.
 
 scm *scm_ifile(const char *name)
 {
@@ -54,18 +177,25 @@ scm *scm_ifile(const char *name)
 
     if ((s = (scm *) calloc(sizeof (scm), 1)))
     {
+        s->z = codec;
+
         if ((s->fp = fopen(name, "r+b")))
         {
-            if (scm_read_preamble(s))
+            s->name = (char *) malloc(strlen(name) + 1);
+            strcpy(s->name, name);
+
+            if (ismanifest(s->fp))
+            {
+                if (scm_read_manifest(s))
+                    return s;
+            }
+            else if (scm_read_preamble(s))
             {
                 if (scm_alloc(s))
-                {
-                    s->name = (char *) malloc(strlen(name) + 1);
-                    strcpy(s->name, name);
                     return s;
-                }
             }
         }
+        else syserr("Failed to open %s", name);
     }
     scm_close(s);
     return NULL;
@@ -90,6 +220,7 @@ scm *scm_ofile(const char *name, int n, int c, int b, int g)
         s->b =  b;
         s->g =  g;
         s->r = 16;
+        s->z = codec;
 
         if ((s->fp = fopen(name, "w+b")))
         {
@@ -111,6 +242,43 @@ scm *scm_ofile(const char *name, int n, int c, int b, int g)
     return NULL;
 }
 
+// Open an SCM TIFF output file to resume an interrupted write. If the file does
+// not yet exist, or was interrupted before its header and HFD were complete,
+// then begin it as scm_ofile does. Otherwise confirm that it has the given
+// parameters and recover it, so that appends continue its page list.
+
+scm *scm_rfile(const char *name, int n, int c, int b, int g)
+{
+    char  buf[sizeof (header) + sizeof (hfd)];
+    scm  *s = NULL;
+    FILE *fp;
+    size_t k;
+
+    assert(name);
+
+    if ((fp = fopen(name, "rb")) == NULL)
+        return scm_ofile(name, n, c, b, g);
+
+    k = fread(buf, 1, sizeof (buf), fp);
+
+    fclose(fp);
+
+    if (k < sizeof (buf))
+        return scm_ofile(name, n, c, b, g);
+
+    if ((s = scm_ifile(name)))
+    {
+        if (s->n == n && s->c == c && s->b == b && s->g == g)
+        {
+            if (scm_recover(s) >= 0)
+                return s;
+        }
+        else apperr("%s: Cannot resume with different parameters", name);
+    }
+    scm_close(s);
+    return NULL;
+}
+
 //------------------------------------------------------------------------------
 
 // Allocate and return a buffer with the proper size to fit one page of data,
@@ -165,6 +333,27 @@ void scm_get_sample_center(int f, long i, long j, long n, double *v)
     scm_vector(f, (i + 0.5) / n, (j + 0.5) / n, v);
 }
 
+// Compute the (n+1)-by-(n+1) sample corner vectors of the n-by-n page at row u
+// column v of the w-by-w page array on face f.
+
+void scm_get_page_corners(int f, long u, long v, long w, int n, double *p)
+{
+    scm_vector_grid(f, (long long) n * u,
+                       (long long) n * v,
+                       (long long) n * w, n + 1, n + 1, 0.0, p);
+}
+
+// Compute the (n+2)-by-(n+2) sample center vectors of the n-by-n page at row u
+// column v of the w-by-w page array on face f, including the one-sample border
+// of a page buffer.
+
+void scm_get_page_centers(int f, long u, long v, long w, int n, double *p)
+{
+    scm_vector_grid(f, (long long) n * u - 1,
+                       (long long) n * v - 1,
+                       (long long) n * w, n + 2, n + 2, 0.5, p);
+}
+
 //------------------------------------------------------------------------------
 
 // Standard-library-compatible long long compare function for bsearch and qsort.
@@ -179,27 +368,6 @@ static int llcompare(const void *p, const void *q)
     else                  return  0;
 }
 
-// Adapt the standard library bsearch to an array of long longs. Return the
-// index of key x in array v of length c
-
-static long long llsearch(long long x, long long c, const long long *v)
-{
-    void  *p = bsearch(&x, v, (size_t) c, sizeof (long long), llcompare);
-    return p ? (long long *) p - v : -1;
-}
-
-// Page x is a leaf if none of its children appear in the array.
-
-static bool isleaf(long long x, long long c, const long long *v)
-{
-    if      (llsearch(scm_page_child(x, 0), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 1), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 2), c, v) >= 0) return false;
-    else if (llsearch(scm_page_child(x, 3), c, v) >= 0) return false;
-
-    else return true;
-}
-
 // Allocate and initialize a sorted array with the indices of all present pages.
 
 static long long scm_scan_indices(scm *s, long long **v)
@@ -232,11 +400,12 @@ static long long scm_scan_indices(scm *s, long long **v)
     return c;
 }
 
-// Allocate and initialize an array giving the file offsets of all present pages
-// in index-sorted order. O(n log n).
+// Allocate and initialize an array of length c giving the file offsets of all
+// present pages, as indexed by occupancy q. If given, p maps each index-sorted
+// page to its position in the array.
 
-static long long scm_scan_offsets(scm *s, long long **v,
-                      long long xc, const long long *xv)
+static long long scm_scan_offsets(scm *s, long long **v, const scm_occ *q,
+                                  long long c, const long long *p)
 {
     ifd d;
 
@@ -245,95 +414,269 @@ static long long scm_scan_offsets(scm *s, long long **v,
 
     // Allocate storage for all offsets.
 
-    if ((v[0] = (long long *) calloc((size_t) xc, sizeof (long long))) == NULL)
+    if ((v[0] = (long long *) calloc((size_t) c, sizeof (long long))) == NULL)
         return 0;
 
     // Scan the file to read the offsets.
 
     for (o = scm_rewind(s); scm_read_ifd(s, &d, o); o = (long long) d.next)
-        if ((i = llsearch((long long) d.page_number.offset, xc, xv)) >= 0)
-            v[0][i] = o;
+        if ((i = scm_occ_search(q, (long long) d.page_number.offset)) >= 0)
+            v[0][p ? p[i] : i] = o;
 
-    return xc;
+    return c;
 }
 
-// Append page x to the index array v of length c. Recursively add all children
-// to depth d. Return the new array length.
+// Link each page of the sorted index array v of length c to its parent. Set
+// w[i] to the position of the parent of page v[i], or -1 if it is absent. The
+// children of one row of parents fill two rows, each visiting its parents in
+// column order, so each parent row is walked twice and the pass is linear.
 
-static long long scm_grow_leaf(long long x, long long **v, long long c, int d)
+static void scm_link_parents(long long c, const long long *v, long long *w)
 {
-    v[0][c++] = x;
+    long long i0 = 0;
+    long long i1 = 0;
+    long long j0 = 0;
+    long long j1 = 0;
 
-    if (d > 0)
+    for (i0 = 0; i0 < c; i0 = i1)
     {
-        c = scm_grow_leaf(scm_page_child(x, 0), v, c, d - 1);
-        c = scm_grow_leaf(scm_page_child(x, 1), v, c, d - 1);
-        c = scm_grow_leaf(scm_page_child(x, 2), v, c, d - 1);
-        c = scm_grow_leaf(scm_page_child(x, 3), v, c, d - 1);
+        const long long l = scm_page_level(v[i0]);
+
+        for (i1 = i0; i1 < c && scm_page_level(v[i1]) == l; i1++)
+            w[i1] = -1;
+
+        // Link this level to the level above, if that level is present.
+
+        if (i0 > 0 && scm_page_level(v[j0]) == l - 1)
+        {
+            long long j = j0;
+            long long k = j0;
+            long long r = -1;
+
+            for (long long i = i0; i < i1; i++)
+            {
+                const long long x = scm_page_parent(v[i]);
+                const long long y = v[i] - scm_page_col(v[i]);
+
+                if (r != y)
+                {
+                    const long long z = x - scm_page_col(x);
+
+                    while (j < j1 && v[j] < z) j++;
+
+                    k = j;
+                    r = y;
+                }
+                while (k < j1 && v[k] < x) k++;
+
+                if (k < j1 && v[k] == x)
+                    w[i] = k;
+            }
+        }
+        j0 = i0;
+        j1 = i1;
     }
-    return c;
 }
 
-// Given index array xv with length xc, extend the page hierarchy adding d
-// levels to each leaf. Allocate a new index array to receive its indices.
+// Return the position of child k of the page at position p of index array v of
+// length c, or -1 if that child is absent. cv gives the position of the first
+// present child in each row of children, and the two children of a row are
+// adjacent in the index order.
 
-static long long scm_grow_leaves(scm *s, long long **v,
-                     long long xc, const long long *xv, int d)
+static long long scm_child(long long c, const long long *v,
+                                        const long long *cv, long long p, int k)
 {
-    // Count the number of pages in the extended catalog.
+    const long long x = scm_page_child(v[p], k);
+    const long long q = cv[2 * p + k / 2];
+
+    if (q >= 0)
+    {
+        if (q     < c && v[q]     == x) return q;
+        if (q + 1 < c && v[q + 1] == x) return q + 1;
+    }
+    return -1;
+}
+
+// Emit into v at position e the children of all pages at positions [p0, p1) of
+// v having non-zero depth in dv, giving each child one less depth. The pages of
+// each parent row give two rows of children, so the result is sorted. Return
+// the new end position.
+
+static long long scm_grow_level(long long *v, unsigned char *dv, long long e,
+                                                 long long p0, long long p1)
+{
+    long long g0;
+    long long g1;
+
+    for (g0 = p0; g0 < p1; g0 = g1)
+    {
+        const long long r = v[g0] - scm_page_col(v[g0]);
+
+        for (g1 = g0; g1 < p1 && v[g1] - scm_page_col(v[g1]) == r; g1++)
+            ;
+
+        for     (int h = 0; h < 2; h++)
+            for (long long j = g0; j < g1; j++)
+                if (dv[j])
+                {
+                    v[e] = scm_page_child(v[j], 2 * h + 0); dv[e++] = dv[j] - 1;
+                    v[e] = scm_page_child(v[j], 2 * h + 1); dv[e++] = dv[j] - 1;
+                }
+    }
+    return e;
+}
+
+// Given the sorted index array xv with length xc, extend the page hierarchy
+// adding d levels to each leaf. Allocate a new index array yv to receive the
+// extended catalog, already sorted, and cv to receive the child rows of each
+// page within it. Note in xp the position of each page of xv within yv and in
+// lf whether each is a leaf. Return the length of the extended catalog.
+
+static long long scm_grow_leaves(scm *s, long long **yv, long long **cv,
+                                         long long  *xp, char *lf,
+                                         long long xc, const long long *xv,
+                                                                    int d)
+{
+    long long     *w  = NULL;
+    unsigned char *dv = NULL;
 
     long long m = xc;
-    long long c = xc;
+    long long c = 0;
     long long i;
 
-    for (i = 0; i < xc; ++i)
-        if (isleaf(xv[i], xc, xv))
-            m += scm_page_count(d);
+    yv[0] = NULL;
+    cv[0] = NULL;
 
-    // Allocate storage for the extended catalog.
+    // Mark the leaves of the basic catalog and count the extended catalog.
 
-    if ((v[0] = (long long *) malloc((size_t) m * sizeof (long long))) == NULL)
+    if ((w = (long long *) malloc((size_t) xc * sizeof (long long))) == NULL)
         return 0;
 
-    // Copy the basic catalog.
+    scm_link_parents(xc, xv, w);
 
-    memcpy(v[0], xv, (size_t) xc * sizeof (long long));
+    for (i = 0; i < xc; i++)
+        lf[i] = 1;
+    for (i = 0; i < xc; i++)
+        if (w[i] >= 0)
+            lf[w[i]] = 0;
+    for (i = 0; i < xc; i++)
+        if (lf[i])
+            m += ((1LL << (2 * d + 2)) - 4) / 3;
 
-    // Extend the catalog.
+    free(w);
 
-    for (i = 0; d && i < xc; ++i)
-        if (isleaf(xv[i], xc, xv))
+    // Build the extended catalog one level at a time, merging the basic pages
+    // of each level with the children of the pages of the level above.
+
+    if ((yv[0] = (long long *) malloc((size_t) m * sizeof (long long))) &&
+        (dv = (unsigned char *) malloc((size_t) m)))
+    {
+        long long p0 = 0;
+        long long p1 = 0;
+        long long a  = 0;
+        long long l  = -1;
+
+        for (;;)
         {
-            c = scm_grow_leaf(scm_page_child(xv[i], 0), v, c, d - 1);
-            c = scm_grow_leaf(scm_page_child(xv[i], 1), v, c, d - 1);
-            c = scm_grow_leaf(scm_page_child(xv[i], 2), v, c, d - 1);
-            c = scm_grow_leaf(scm_page_child(xv[i], 3), v, c, d - 1);
+            long long a1;
+            long long b0;
+            long long b1;
+
+            // Continue to the next level if any page of this one is growing,
+            // else skip ahead to the level of the next basic page.
+
+            for (i = p0; i < p1 && dv[i] == 0; i++)
+                ;
+
+            if      (i  < p1) l = l + 1;
+            else if (a  < xc) l = scm_page_level(xv[a]);
+            else break;
+
+            // Find the basic pages of this level, and generate the children
+            // of the level above beyond them.
+
+            for (a1 = a; a1 < xc && scm_page_level(xv[a1]) == l; a1++)
+                ;
+
+            b0 = c + (a1 - a);
+            b1 = scm_grow_level(yv[0], dv, b0, p0, p1);
+
+            // Merge the two, preferring the basic page where both appear.
+
+            p0 = c;
+
+            while (a < a1 || b0 < b1)
+            {
+                if (b0 == b1 || (a < a1 && xv[a] <= yv[0][b0]))
+                {
+                    if (b0 < b1 && xv[a] == yv[0][b0])
+                        b0++;
+
+                    yv[0][c] = xv[a];
+                    dv[c]    = lf[a] ? (unsigned char) d : 0;
+                    xp[a]    = c;
+                    a++;
+                    c++;
+                }
+                else
+                {
+                    yv[0][c] = yv[0][b0];
+                    dv[c]    = dv[b0];
+                    b0++;
+                    c++;
+                }
+            }
+            p1 = c;
         }
+    }
+    free(dv);
 
-    // Sort the extended catalog.
+    // Note the child rows of every page of the extended catalog.
 
-    qsort(v[0], (size_t) c, sizeof (long long), llcompare);
+    if (c && (cv[0] = (long long *) malloc((size_t) c * 2 * sizeof (long long)))
+          && (w     = (long long *) malloc((size_t) c *     sizeof (long long))))
+    {
+        scm_link_parents(c, yv[0], w);
 
-    return c;
+        for (i = 0; i < 2 * c; i++)
+            cv[0][i] = -1;
+
+        for (i = 0; i < c; i++)
+            if (w[i] >= 0)
+            {
+                const long long k = 2 * w[i] + scm_page_order(yv[0][i]) / 2;
+
+                if (cv[0][k] < 0)
+                    cv[0][k] = i;
+            }
+
+        free(w);
+        return c;
+    }
+    free(cv[0]);
+    free(yv[0]);
+    yv[0] = NULL;
+    cv[0] = NULL;
+    return 0;
 }
 
-// Compute the extrema of an internal node. This is trivially defined in terms
-// of the extrema of its children.
+// Compute the extrema of the internal node at position p of the extended index
+// array v of length c. This is trivially defined in terms of the extrema of its
+// children.
 
-static void scm_bound_node(scm *s, long long x,
-                                   long long c, const long long *v, float *av,
-                                                                    float *zv)
+static void scm_bound_node(scm *s, long long p, long long c, const long long *v,
+                                                            const long long *cv,
+                                                            float *av,
+                                                            float *zv)
 {
-    long long i  = llsearch(x, c, v);
-
-    long long i0 = llsearch(scm_page_child(x, 0), c, v);
-    long long i1 = llsearch(scm_page_child(x, 1), c, v);
-    long long i2 = llsearch(scm_page_child(x, 2), c, v);
-    long long i3 = llsearch(scm_page_child(x, 3), c, v);
+    long long i0 = scm_child(c, v, cv, p, 0);
+    long long i1 = scm_child(c, v, cv, p, 1);
+    long long i2 = scm_child(c, v, cv, p, 2);
+    long long i3 = scm_child(c, v, cv, p, 3);
 
     for (int k = 0; k < s->c; ++k)
     {
-        const long long di = i * s->c + k;
+        const long long di = p * s->c + k;
 
         av[di] =  FLT_MAX;
         zv[di] = -FLT_MAX;
@@ -365,44 +708,62 @@ static void scm_bound_node(scm *s, long long x,
     }
 }
 
-// Recursively subdivide a leaf node to a depth of d. Determine the extrema of
-// each new leaf by scanning the pixel buffer pp.
+// Recursively subdivide the leaf node at position p to a depth of d. Determine
+// the extrema of each new leaf by scanning the pixel buffer pp or, if given,
+// by taking those of sub-page j of level k of the page bounds e.
 
-static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
-                                   long long yc, const long long *yv,
+static void scm_bound_leaf(scm *s, long long p, const float     *pp,
+                                                const float     *e,
+                                   long long c, const long long *v,
+                                                const long long *cv,
                                    float *av,
-                                   float *zv,
+                                   float *zv, int k, long long j,
                                    int l, int r, int t, int b, int d)
 {
-    long long i;
-
     // Subdivide as far as needed.
 
     if (d > 0)
     {
-        long long x0 = scm_page_child(x, 0);
-        long long x1 = scm_page_child(x, 1);
-        long long x2 = scm_page_child(x, 2);
-        long long x3 = scm_page_child(x, 3);
+        long long i0 = scm_child(c, v, cv, p, 0);
+        long long i1 = scm_child(c, v, cv, p, 1);
+        long long i2 = scm_child(c, v, cv, p, 2);
+        long long i3 = scm_child(c, v, cv, p, 3);
 
         int h = (l + r) / 2;
-        int v = (b + t) / 2;
+        int m = (b + t) / 2;
+
+        if (i0 >= 0) scm_bound_leaf(s, i0, pp, e, c, v, cv, av, zv,
+                                    k + 1, j * 4 + 0, l, h, t, m, d - 1);
+        if (i1 >= 0) scm_bound_leaf(s, i1, pp, e, c, v, cv, av, zv,
+                                    k + 1, j * 4 + 1, h, r, t, m, d - 1);
+        if (i2 >= 0) scm_bound_leaf(s, i2, pp, e, c, v, cv, av, zv,
+                                    k + 1, j * 4 + 2, l, h, m, b, d - 1);
+        if (i3 >= 0) scm_bound_leaf(s, i3, pp, e, c, v, cv, av, zv,
+                                    k + 1, j * 4 + 3, h, r, m, b, d - 1);
+
+        scm_bound_node(s, p, c, v, cv, av, zv);
+    }
 
-        scm_bound_leaf(s, x0, pp, yc, yv, av, zv, l, h, t, v, d - 1);
-        scm_bound_leaf(s, x1, pp, yc, yv, av, zv, h, r, t, v, d - 1);
-        scm_bound_leaf(s, x2, pp, yc, yv, av, zv, l, h, v, b, d - 1);
-        scm_bound_leaf(s, x3, pp, yc, yv, av, zv, h, r, v, b, d - 1);
+    // Copy the extrema of the sub-page from the page bounds.
 
-        scm_bound_node(s, x, yc, yv, av, zv);
+    else if (e)
+    {
+        const float *f = e + (((1LL << (2 * k)) - 1) / 3 + j) * s->c * 2;
+
+        for (int i = 0; i < s->c; ++i)
+        {
+            av[p * s->c + i] = f[i * 2 + 0];
+            zv[p * s->c + i] = f[i * 2 + 1];
+        }
     }
 
     // Sample the leaf subdivision and note the extrema.
 
-    else if ((i = llsearch(x, yc, yv)) >= 0)
+    else
     {
-        for (int k = 0; k < s->c; ++k)
+        for (int i = 0; i < s->c; ++i)
         {
-            const long long di = i * s->c + k;
+            const long long di = p * s->c + i;
 
             av[di] =  FLT_MAX;
             zv[di] = -FLT_MAX;
@@ -410,7 +771,7 @@ static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
             for     (int y = t; y < b; ++y)
                 for (int x = l; x < r; ++x)
                 {
-                    const int si = ((y + 1) * (s->n + 2) + (x + 1)) * s->c + k;
+                    const int si = ((y + 1) * (s->n + 2) + (x + 1)) * s->c + i;
 
                     if (av[di] > pp[si]) av[di] = pp[si];
                     if (zv[di] < pp[si]) zv[di] = pp[si];
@@ -419,65 +780,181 @@ static void scm_bound_leaf(scm *s, long long x,  const float     *pp,
     }
 }
 
-// Compute the min and max values of all pages. ov gives the file offset of all
-// real pages and xv gives the page index of all real pages. yv gives the page
-// index of all pages, real or virtual, and d gives the subdivision depth of
-// virtual pages. Allocate and initialize minv and maxv with the min and max
-// values of all real and virtual pages.
+// Bound the leaf at position p of the extended catalog, with the page at file
+// offset o. Take the bounds from the file where possible, else decode the page
+// into buffer pp.
+
+static void scm_bound_page(scm *s, float *pp, long long p, long long o,
+                                   long long c, const long long *v,
+                                                const long long *cv,
+                                   float *av,
+                                   float *zv, int d)
+{
+    ifd f;
+
+    if (d <= SCM_BOUNDS_DEPTH
+        && scm_read_ifd   (s, &f, o)
+        && scm_read_bounds(s, f.strip_byte_counts.offset,
+                   (uint16_t) f.strip_byte_counts.count, s->boundv))
+
+        scm_bound_leaf(s, p, NULL, s->boundv, c, v, cv,
+                       av, zv, 0, 0, 0, s->n, 0, s->n, d);
+
+    else if (scm_read_page(s, o, pp))
+
+        scm_bound_leaf(s, p, pp, NULL, c, v, cv,
+                       av, zv, 0, 0, 0, s->n, 0, s->n, d);
+}
+
+// Compute the min and max values of all pages. xv gives the page index of all
+// real pages, xp their positions in the extended catalog, and lf which are
+// leaves. yv gives the page index of all pages, real or virtual, cv their child
+// rows, and ov their file offsets. d gives the subdivision depth of virtual
+// pages. Allocate and initialize minv and maxv with the min and max values of
+// all real and virtual pages.
+//
+// Leaves are bounded in parallel, each thread reading through its own handle
+// on the file into its own page buffer. Internal nodes are then reduced from
+// the bottom up, one level at a time.
 
 static bool scm_bound(scm *s, long long xc, const long long *xv,
+                                            const long long *xp,
+                                            const char      *lf,
                               long long yc, const long long *yv,
-                              long long oc, const long long *ov,
-                                                    void **minv,
-                                                    void **maxv, int d)
+                                            const long long *cv,
+                                            const long long *ov,
+                                                       void **minv,
+                                                       void **maxv, int d)
 {
     const size_t sz = tifsizeof(scm_type(s));
     const size_t yz = (size_t) yc * (size_t) s->c;
 
-    float *pp = NULL;
-    float *av = NULL;
-    float *zv = NULL;
+#ifdef _OPENMP
+    const int tc = omp_get_max_threads();
+#else
+    const int tc = 1;
+#endif
+
+    scm   **tv = NULL;
+    float **pv = NULL;
+    float  *av = NULL;
+    float  *zv = NULL;
+
+    long long i;
+    long long i0;
+    long long i1;
 
     bool st = false;
+    int  k;
+
+    fflush(s->fp);
 
-    if ((pp = scm_alloc_buffer(s)))
+    if ((tv = (scm   **) calloc((size_t) tc, sizeof (scm   *))) &&
+        (pv = (float **) calloc((size_t) tc, sizeof (float *))))
     {
-        if ((av = (float *) malloc(yz * sizeof (float))) &&
-            (zv = (float *) malloc(yz * sizeof (float))))
-        {
-            // Calculate bounds for all pages.
+        // Open a reader and a page buffer for each thread.
 
-            for (long long i = xc - 1; i >= 0; --i)
+        for (k = 0; k < tc; k++)
+            if ((tv[k] = k ? scm_ifile(s->name) : s) == NULL ||
+                (pv[k] = scm_alloc_buffer(tv[k]))    == NULL)
+                break;
+
+        if (k == tc)
+        {
+            if ((av = (float *) malloc(yz * sizeof (float))) &&
+                (zv = (float *) malloc(yz * sizeof (float))))
             {
-                if (isleaf(xv[i], xc, xv))
+                // Calculate bounds for all leaves.
+
+                #pragma omp parallel for schedule(dynamic)
+                for (i = 0; i < xc; ++i)
+                    if (lf[i])
+                    {
+#ifdef _OPENMP
+                        const int t = omp_get_thread_num();
+#else
+                        const int t = 0;
+#endif
+                        scm_bound_page(tv[t], pv[t], xp[i], ov[xp[i]],
+                                       yc, yv, cv, av, zv, d);
+                    }
+
+                // Calculate bounds for all nodes, deepest level first.
+
+                for (i1 = xc; i1 > 0; i1 = i0)
                 {
-                    if (scm_read_page (s, ov[i], pp))
-                        scm_bound_leaf(s, xv[i], pp,
-                                       yc, yv, av, zv, 0, s->n, 0, s->n, d);
+                    const long long l = scm_page_level(xv[i1 - 1]);
+
+                    for (i0 = i1; i0 > 0; --i0)
+                        if (scm_page_level(xv[i0 - 1]) != l)
+                            break;
+
+                    #pragma omp parallel for
+                    for (i = i0; i < i1; ++i)
+                        if (!lf[i])
+                            scm_bound_node(s, xp[i], yc, yv, cv, av, zv);
                 }
-                else scm_bound_node(s, xv[i], yc, yv, av, zv);
-            }
 
-            // Convert floating point values to the SCM value type.
+                // Convert floating point values to the SCM value type.
 
-            if ((minv[0] = malloc(yz * sz)) &&
-                (maxv[0] = malloc(yz * sz)))
-            {
-                ftob(minv[0], av, yz, s->b, s->g);
-                ftob(maxv[0], zv, yz, s->b, s->g);
+                if ((minv[0] = malloc(yz * sz)) &&
+                    (maxv[0] = malloc(yz * sz)))
+                {
+                    ftob(minv[0], av, yz, s->b, s->g);
+                    ftob(maxv[0], zv, yz, s->b, s->g);
 
-                st = true;
+                    st = true;
+                }
             }
             free(zv);
             free(av);
         }
-        free(pp);
+
+        for (k = 0; k < tc; k++)
+        {
+            free(pv[k]);
+
+            if (k && tv[k])
+                scm_close(tv[k]);
+        }
     }
+    free(pv);
+    free(tv);
+
     return st;
 }
 
 //------------------------------------------------------------------------------
 
+// Determine the shard of collection s holding catalog offset o and reduce o to
+// an offset within that shard. A single file is its own only shard.
+
+static scm *scm_shard(scm *s, long long *o)
+{
+    if (s->sv)
+    {
+        scm *t = s->sv[*o >> SCM_SHARD_SHIFT];
+        *o    &= (1LL << SCM_SHARD_SHIFT) - 1;
+        return t;
+    }
+    return s;
+}
+
+// Confirm that SCM s may be written. Collections are read-only, as each of
+// their shards is written separately.
+
+static bool writable(scm *s)
+{
+    if (s->sv)
+    {
+        apperr("%s: SCM collection is read-only", s->name);
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
 // Append a page at the current SCM TIFF file pointer. Offset b is the previous
 // IFD, which will be updated to include the new page as next. x is the breadth-
 // first page index. f points to a page of data to be written. Return the offset
@@ -493,15 +970,19 @@ long long scm_append(scm *s, long long b, long long x, const float *f)
     uint64_t lo;
     uint16_t sc;
 
+    scm_codec e;
     ifd d;
 
-    if (scm_init_ifd(s, &d))
+    if (writable(s) && scm_init_ifd(s, &d))
     {
         if (scm_ffwd(s))
         {
             if ((o = scm_write_ifd(s, &d, 0)) >= 0)
             {
-                if ((scm_write_data(s, f, &oo, &lo, &sc)))
+                scm_page_bounds(s, f, s->boundv);
+
+                if (scm_write_data(s, f, &oo, &lo, &sc, &e) &&
+                    scm_write_bounds(s, s->boundv))
                 {
                     if (scm_align(s) >= 0)
                     {
@@ -512,6 +993,8 @@ long long scm_append(scm *s, long long b, long long x, const float *f)
                         scm_field(&d.rows_per_strip,    0x0116,  3,  1, rr);
                         scm_field(&d.strip_byte_counts, 0x0117,  4, sc, lo);
                         scm_field(&d.page_number,       0x0129,  4,  1, xx);
+                        scm_field(&d.predictor,         0x013D,  3,  1, e.p);
+                        scm_field(&d.compression,       0x0103,  3,  1, e.z);
 
                         if (scm_write_ifd(s, &d, o) >= 1)
                         {
@@ -543,6 +1026,12 @@ long long scm_repeat(scm *s, long long b, scm *t, long long o)
 {
     assert(s);
     assert(t);
+
+    if (!writable(s))
+        return 0;
+
+    t = scm_shard(t, &o);
+
     assert(s->n == t->n);
     assert(s->c == t->c);
     assert(s->b == t->b);
@@ -562,11 +1051,16 @@ long long scm_repeat(scm *s, long long b, scm *t, long long o)
 
         d.next = 0;
 
+        // Carry the page bounds along with the data, if the source has them.
+
+        bool bb = scm_read_bounds(t, lo, sc, t->boundv);
+
         if (scm_read_zips(t, t->zipv, oo, lo, sc, O, L))
         {
             if ((o = scm_write_ifd(s, &d, 0)) >= 0)
             {
-                if (scm_write_zips(s, t->zipv, &oo, &lo, &sc, O, L))
+                if (scm_write_zips(s, t->zipv, &oo, &lo, &sc, O, L) &&
+                    (!bb || scm_write_bounds(s, t->boundv)))
                 {
                     if (scm_align(s) >= 0)
                     {
@@ -596,6 +1090,121 @@ long long scm_repeat(scm *s, long long b, scm *t, long long o)
     return 0;
 }
 
+// Return the end of the metadata field f with elements of size z, or zero if it
+// has none or if it lies beyond the file length n.
+
+static long long scm_field_end(const field *f, size_t z, long long n)
+{
+    const long long e = (long long) (f->offset + f->count * z);
+
+    return (f->count && f->offset && e <= n) ? e : 0;
+}
+
+// Return the end of the page with IFD d, or zero if any part of it lies beyond
+// the file length n. An append interrupted after linking its IFD but before its
+// data reached the disk leaves such a torn page.
+
+static long long scm_page_end(scm *s, const ifd *d, long long n)
+{
+    const uint64_t oo = d->strip_offsets.offset;
+    const uint64_t lo = d->strip_byte_counts.offset;
+    const uint16_t sc = (uint16_t) d->strip_byte_counts.count;
+
+    uint64_t O[256];
+    uint32_t L[256];
+    bounds   h;
+
+    long long e = (long long) (lo + sc * sizeof (uint32_t));
+
+    if (sc == 0 || sc != d->strip_offsets.count)                return 0;
+    if ((long long) (oo + sc * sizeof (uint64_t)) > n || e > n) return 0;
+
+    if (!scm_read(s, O, sc * sizeof (uint64_t), (long long) oo)) return 0;
+    if (!scm_read(s, L, sc * sizeof (uint32_t), (long long) lo)) return 0;
+
+    for (int i = 0; i < sc; i++)
+        if ((long long) (O[i] + L[i]) > n)
+            return 0;
+
+    // Include the page bounds, if the page has them.
+
+    if (e + (long long) sizeof (bounds) <= n && scm_read(s, &h, sizeof (bounds), e))
+    {
+        if (h.magic    == SCM_BOUNDS_MAGIC &&
+            h.depth    == SCM_BOUNDS_DEPTH &&
+            h.channels == (uint16_t) s->c)
+        {
+            e += (long long) (sizeof (bounds) + SCM_BOUNDS_COUNT * 2
+                                              * (size_t) s->c * sizeof (float));
+            if (e > n)
+                return 0;
+        }
+    }
+    return (e + 1) & ~1LL;
+}
+
+// Prepare SCM s to resume appending after an interruption. Follow the list of
+// pages, stopping at the first that is torn, lies beyond the end of the file,
+// or is not an IFD at all. Unlink it and truncate the file after the last page
+// or metadata that remains intact. Return the number of pages retained.
+
+long long scm_recover(scm *s)
+{
+    header h;
+    hfd    d;
+    ifd    i;
+
+    long long k = 0;
+    long long b = 0;
+    long long n;
+    long long e;
+    long long o;
+    long long x;
+
+    assert(s);
+
+    if (writable(s) && (n = scm_length(s)) >= 0)
+    {
+        if (scm_read_header(s, &h) && scm_read_hfd(s, &d, h.first_ifd))
+        {
+            const size_t z = tifsizeof(d.page_minimum.type);
+
+            // Keep any metadata written by a previous finish.
+
+            e = (long long) (h.first_ifd + sizeof (hfd));
+            e = max(e, scm_field_end(&d.page_index,   sizeof (long long), n));
+            e = max(e, scm_field_end(&d.page_offset,  sizeof (long long), n));
+            e = max(e, scm_field_end(&d.page_minimum, z, n));
+            e = max(e, scm_field_end(&d.page_maximum, z, n));
+            e = max(e, scm_field_end(&d.description,  1, n));
+
+            // Keep every intact page up to the first that is not.
+
+            for (o = (long long) d.next; o; o = (long long) i.next, k++)
+            {
+                if (o + (long long) sizeof (ifd) > n
+                    || !scm_read(s, &i, sizeof (ifd), o) || !is_ifd(&i)
+                    || (x = scm_page_end(s, &i, n)) == 0)
+                {
+                    apperr("%s: Discarding torn page at offset %lld", s->name, o);
+                    break;
+                }
+                e = max(e, x);
+                b = o;
+            }
+
+            if (o == 0 || scm_link_list(s, 0, b))
+            {
+                if (e == n || scm_trunc(s, e))
+                {
+                    return k;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
 // Move the SCM TIFF file pointer to the first IFD and return its offset.
 
 long long scm_rewind(scm *s)
@@ -618,7 +1227,37 @@ long long scm_rewind(scm *s)
     return 0;
 }
 
-// Calculate and write all metadata to SCM s.
+// Reserve n bytes at the end of SCM s to receive the metadata of scm_finish.
+// Reserving before the first page is appended places the metadata at the head
+// of the file, where a reader finds the catalog without seeking past the data.
+
+bool scm_reserve(scm *s, long long n)
+{
+    static const char z[4096] = { 0 };
+
+    long long k;
+
+    assert(s);
+
+    if (writable(s) && scm_ffwd(s) && (s->ho = scm_align(s)) >= 0)
+    {
+        for (k = n; k > 0; k -= (long long) sizeof (z))
+            if (scm_write(s, z, (size_t) min(k, (long long) sizeof (z))) < 0)
+                break;
+
+        if (k <= 0 && scm_align(s) >= 0)
+        {
+            s->hn = n;
+            return true;
+        }
+    }
+    s->ho = 0;
+    s->hn = 0;
+    return false;
+}
+
+// Calculate and write all metadata to SCM s. If it fits in the space reserved
+// by scm_reserve then write it there, else append it.
 
 bool scm_finish(scm *s, const char *txt, int d)
 {
@@ -628,24 +1267,41 @@ bool scm_finish(scm *s, const char *txt, int d)
 
     long long  xc =    0;
     long long *xv = NULL;
+    long long *xp = NULL;
+    char      *lf = NULL;
     long long  yc =    0;
     long long *yv = NULL;
+    long long *cv = NULL;
     long long  oc =    0;
     long long *ov = NULL;
     void    *minv = NULL;
     void    *maxv = NULL;
+    scm_occ    xq;
 
     bool st = false;
 
+    memset(&xq, 0, sizeof (scm_occ));
+
+    // Finish each shard of a collection separately.
+
+    if (s->sv)
+    {
+        for (int k = 0; k < s->sc; k++)
+            st = scm_finish(s->sv[k], txt, d) || st;
+        return st;
+    }
+
     // Allocate and initialize buffers for all metadata data.
 
-    if ((xc = scm_scan_indices(s, &xv)))
+    if ((xc = scm_scan_indices(s, &xv)) && scm_occ_init(&xq, xc, xv) &&
+        (xp = (long long *) malloc((size_t) xc * sizeof (long long))) &&
+        (lf = (char      *) malloc((size_t) xc)))
     {
-        if ((yc = scm_grow_leaves(s, &yv, xc, xv, d)))
+        if ((yc = scm_grow_leaves(s, &yv, &cv, xp, lf, xc, xv, d)))
         {
-            if ((oc = scm_scan_offsets(s, &ov, yc, yv)))
+            if ((oc = scm_scan_offsets(s, &ov, &xq, yc, xp)))
             {
-                if (scm_bound(s, xc, xv, yc, yv, oc, ov, &minv, &maxv, d))
+                if (scm_bound(s, xc, xv, xp, lf, yc, yv, cv, ov, &minv, &maxv, d))
                 {
                     // Append all metadata.
 
@@ -658,7 +1314,11 @@ bool scm_finish(scm *s, const char *txt, int d)
                     uint64_t zo = 0;
                     uint64_t to = 0;
 
-                    if (scm_ffwd(s))
+                    const long long hz = (long long) (yc * sizeof (long long)
+                                                    + oc * sizeof (long long)
+                                                    + bc * sz * 2 + tc);
+
+                    if (hz <= s->hn ? scm_seek(s, s->ho) : scm_ffwd(s))
                     {
                         yo = scm_write(s,   yv, (size_t) yc * sizeof (long long));
                         oo = scm_write(s,   ov, (size_t) oc * sizeof (long long));
@@ -690,15 +1350,49 @@ bool scm_finish(scm *s, const char *txt, int d)
         }
     }
 
+    scm_occ_free(&xq);
+
     free(maxv);
     free(minv);
+    free(cv);
     free(yv);
     free(ov);
+    free(lf);
+    free(xp);
     free(xv);
 
     return st;
 }
 
+// Determine the length of the metadata that scm_finish would write for the
+// cataloged pages of SCM s, given description txt and oversample level d.
+
+long long scm_finish_size(scm *s, const char *txt, int d)
+{
+    const size_t sz = tifsizeof(scm_type(s));
+
+    long long *xp = NULL;
+    char      *lf = NULL;
+    long long *yv = NULL;
+    long long *cv = NULL;
+    long long  yc = 0;
+
+    assert(s);
+    assert(s->xv);
+
+    if ((xp = (long long *) malloc((size_t) s->xc * sizeof (long long))) &&
+        (lf = (char      *) malloc((size_t) s->xc)))
+        yc = scm_grow_leaves(s, &yv, &cv, xp, lf, s->xc, s->xv, d);
+
+    free(cv);
+    free(yv);
+    free(lf);
+    free(xp);
+
+    return yc * (long long) (2 * sizeof (long long) + 2 * sz * (size_t) s->c)
+              + (long long) strlen(txt) + 1;
+}
+
 // LibTIFF doesn't allow a page with a non-zero size to have no data given.
 // As a cheap hack, point the header fields at the first page's data.
 
@@ -712,6 +1406,13 @@ bool scm_polish(scm *s)
     hfd    d;
     ifd    i;
 
+    if (s->sv)
+    {
+        for (int k = 0; k < s->sc; k++)
+            st = scm_polish(s->sv[k]) || st;
+        return st;
+    }
+
     if (scm_read_header(s, &h))
     {
         if (scm_read_hfd(s, &d, h.first_ifd))
@@ -730,7 +1431,7 @@ bool scm_polish(scm *s)
 //------------------------------------------------------------------------------
 
 // Read the SCM TIFF IFD at offset o. Assume p provides space for one page of
-// data to be stored.
+// data to be stored. If s is a collection, o is a catalog offset.
 
 bool scm_read_page(scm *s, long long o, float *p)
 {
@@ -738,13 +1439,17 @@ bool scm_read_page(scm *s, long long o, float *p)
 
     assert(s);
 
+    s = scm_shard(s, &o);
+
     if (scm_read_ifd(s, &i, o))
     {
         uint64_t oo = (uint64_t) i.strip_offsets.offset;
         uint64_t lo = (uint64_t) i.strip_byte_counts.offset;
         uint16_t sc = (uint16_t) i.strip_byte_counts.count;
+        uint16_t pr = (uint16_t) i.predictor.offset;
+        uint16_t co = (uint16_t) i.compression.offset;
 
-        return scm_read_data(s, p, oo, lo, sc);
+        return scm_read_data(s, p, oo, lo, sc, pr, co);
     }
     else apperr("Failed to read SCM TIFF IFD from %s", s->name);
 
@@ -753,6 +1458,85 @@ bool scm_read_page(scm *s, long long o, float *p)
 
 //------------------------------------------------------------------------------
 
+// Standard-library-compatible page pair compare function for qsort. Order by
+// index, and by offset among equal indices, thus by shard within collections.
+
+static int prcompare(const void *p, const void *q)
+{
+    const scm_pair *a = (const scm_pair *) p;
+    const scm_pair *b = (const scm_pair *) q;
+
+    if      (a->x < b->x) return -1;
+    else if (a->x > b->x) return +1;
+    else if (a->o < b->o) return -1;
+    else if (a->o > b->o) return +1;
+    else                  return  0;
+}
+
+// Catalog all shards of collection s and merge them into a single catalog
+// with shard-qualified offsets. Where shards give the same page, the first-
+// listed shard wins.
+
+static bool scm_scan_shards(scm *s)
+{
+    scm_pair *v = NULL;
+
+    long long c = 0;
+    long long i;
+    long long j;
+    int       k;
+
+    for (k = 0; k < s->sc; k++)
+        if (scm_scan_catalog(s->sv[k]))
+            c += s->sv[k]->xc;
+        else
+            return false;
+
+    if ((v = (scm_pair *) malloc((size_t) c * sizeof (scm_pair))) == NULL)
+        return false;
+
+    // Gather and sort the catalogs of all shards, releasing them as we go.
+
+    for (c = 0, k = 0; k < s->sc; k++)
+    {
+        scm *t = s->sv[k];
+
+        for (i = 0; i < t->xc; i++, c++)
+        {
+            v[c].x = t->xv[i];
+            v[c].o = t->ov[i] | ((long long) k << SCM_SHARD_SHIFT);
+        }
+
+        free(t->xv); t->xv = NULL; t->xc = 0;
+        free(t->ov); t->ov = NULL; t->oc = 0;
+    }
+
+    qsort(v, (size_t) c, sizeof (scm_pair), prcompare);
+
+    // Copy the unique pages to the catalog.
+
+    if ((s->xv = (long long *) malloc((size_t) c * sizeof (long long))) &&
+        (s->ov = (long long *) malloc((size_t) c * sizeof (long long))))
+    {
+        for (j = 0, i = 0; i < c; i++)
+            if (j == 0 || s->xv[j - 1] != v[i].x)
+            {
+                s->xv[j] = v[i].x;
+                s->ov[j] = v[i].o;
+                j++;
+            }
+
+        s->xc = j;
+        s->oc = j;
+    }
+    free(v);
+
+    if (s->xv && s->ov && s->xc)
+        return scm_occ_init(&s->xq, s->xc, s->xv);
+
+    return false;
+}
+
 // Scan the file and catalog the index and offset of all pages.
 
 bool scm_scan_catalog(scm *s)
@@ -764,13 +1548,22 @@ bool scm_scan_catalog(scm *s)
     if (s->xv) free(s->xv);
     if (s->ov) free(s->ov);
 
-    // Scan the indices and offsets.
+    s->xv = NULL;
+    s->ov = NULL;
+
+    scm_occ_free(&s->xq);
+
+    if (s->sv)
+        return scm_scan_shards(s);
+
+    // Scan the indices and offsets and index the occupancy of all levels.
 
     if ((s->xc = scm_scan_indices(s, &s->xv)))
     {
-        if ((s->oc = scm_scan_offsets(s, &s->ov, s->xc, s->xv)))
+        if (scm_occ_init(&s->xq, s->xc, s->xv))
         {
-            return true;
+            if ((s->oc = scm_scan_offsets(s, &s->ov, &s->xq, s->xc, NULL)))
+                return true;
         }
     }
     return false;
@@ -817,7 +1610,126 @@ long long scm_search(scm *s, long long x)
     if (x < s->xv[        0]) return -1;
     if (x > s->xv[s->xc - 1]) return -1;
 
-    return llsearch(x, s->xc, s->xv);
+    return scm_occ_search(&s->xq, x);
+}
+
+// Determine whether cataloged page x is a leaf, having no children present.
+
+bool scm_is_leaf(scm *s, long long x)
+{
+    assert(s);
+    assert(s->xv);
+
+    return scm_occ_leaf(&s->xq, x);
 }
 
 //------------------------------------------------------------------------------
+
+// Standard-library-compatible compare function for offset pairs.
+
+static int opcompare(const void *p, const void *q)
+{
+    const scm_pair *a = (const scm_pair *) p;
+    const scm_pair *b = (const scm_pair *) q;
+
+    if      (a->o < b->o) return -1;
+    else if (a->o > b->o) return +1;
+    else                  return  0;
+}
+
+// Begin an iteration over the catalog of SCM s, in file order or level order
+// as given by SCM_ORDER_FILE or SCM_ORDER_LEVEL, reading ahead k pages. The
+// data of each page extends to the page following it in the file.
+
+scm_iter *scm_iter_open(scm *s, int order, int k)
+{
+    scm_iter *t = NULL;
+    scm_pair *v = NULL;
+
+    assert(s);
+    assert(s->ov);
+
+    if ((t = (scm_iter *) calloc(1, sizeof (scm_iter))) &&
+        (v = (scm_pair *) malloc((size_t) s->oc * sizeof (scm_pair))) &&
+        (t->pv = (long long *) malloc((size_t) s->oc * sizeof (long long))) &&
+        (t->ev = (long long *) malloc((size_t) s->oc * sizeof (long long))))
+    {
+        const long long m = ~((1LL << SCM_SHARD_SHIFT) - 1);
+
+        long long i;
+
+        t->s = s;
+        t->k = k;
+        t->c = s->oc;
+
+        // Sort the catalog by offset, which is shard order for collections.
+
+        for (i = 0; i < s->oc; i++)
+        {
+            v[i].x = i;
+            v[i].o = s->ov[i];
+        }
+        qsort(v, (size_t) s->oc, sizeof (scm_pair), opcompare);
+
+        for (i = 0; i < s->oc; i++)
+        {
+            if (i + 1 < s->oc && (v[i].o & m) == (v[i + 1].o & m))
+                t->ev[v[i].x] = v[i + 1].o;
+            else
+                t->ev[v[i].x] = 0;
+
+            t->pv[i] = (order == SCM_ORDER_FILE) ? v[i].x : i;
+        }
+        free(v);
+        return t;
+    }
+    free(v);
+    scm_iter_close(t);
+    return NULL;
+}
+
+// Note in i the catalog position of the next page of iteration t. Advise the
+// system of the pages to be read next. Return false when the iteration is done.
+
+bool scm_iter_next(scm_iter *t, long long *i)
+{
+    assert(t);
+    assert(i);
+
+    for (; t->a < t->c && t->a <= t->i + t->k; t->a++)
+    {
+        long long p = t->pv[t->a];
+        long long o = t->s->ov[p];
+        long long e = t->ev[p];
+        long long n = 0;
+
+        scm *u = scm_shard(t->s, &o);
+
+        if (e)
+        {
+            scm_shard(t->s, &e);
+            n = e - o;
+        }
+        if (o)
+            scm_advise(u, o, n);
+    }
+
+    if (t->i < t->c)
+    {
+        *i = t->pv[t->i++];
+        return true;
+    }
+    return false;
+}
+
+// Release iteration t.
+
+void scm_iter_close(scm_iter *t)
+{
+    if (t)
+    {
+        free(t->ev);
+        free(t->pv);
+        free(t);
+    }
+}
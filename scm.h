@@ -23,6 +23,9 @@ void scm_close(scm *);
 
 scm *scm_ifile(const char *);
 scm *scm_ofile(const char *, int, int, int, int);
+scm *scm_rfile(const char *, int, int, int, int);
+
+void scm_set_codec(int);
 
 //------------------------------------------------------------------------------
 // SCM TIFF parameter queries
@@ -36,14 +39,19 @@ int scm_get_g(scm *);
 
 void scm_get_sample_corners(int, long, long, long, double *);
 void scm_get_sample_center (int, long, long, long, double *);
+void scm_get_page_corners  (int, long, long, long, int, double *);
+void scm_get_page_centers  (int, long, long, long, int, double *);
 
 //------------------------------------------------------------------------------
 // SCM TIFF file read/write.
 
 long long scm_rewind(scm *);
+long long scm_recover(scm *);
 long long scm_append(scm *, long long, long long, const float *);
 long long scm_repeat(scm *, long long, scm *, long long);
 bool      scm_finish(scm *, const char *, int);
+bool      scm_reserve(scm *, long long);
+long long scm_finish_size(scm *, const char *, int);
 bool      scm_polish(scm *);
 
 bool scm_read_page(scm *, long long, float *);
@@ -57,7 +65,36 @@ long long scm_get_length(scm *);
 long long scm_get_index (scm *, long long);
 long long scm_get_offset(scm *, long long);
 
-long long scm_search(scm *, long long);
+long long scm_search (scm *, long long);
+bool      scm_is_leaf(scm *, long long);
+
+scm_iter *scm_iter_open (scm *, int, int);
+bool      scm_iter_next (scm_iter *, long long *);
+void      scm_iter_close(scm_iter *);
+
+//------------------------------------------------------------------------------
+// SCM TIFF visibility query.
+
+// A view gives up to six inward-facing frustum planes, an optional cone about
+// axis A with half-angle a at eye E, the radius range of the first channel as
+// given to normal -R, the projection scale k in pixels per unit length at unit
+// distance, and the screen-space error target e in pixels per sample.
+
+typedef struct
+{
+    double P[6][4];             // Frustum planes, with P.v + P[3] >= 0 inside
+    int    pc;                  // Frustum plane count
+    double E[3];                // Eye position
+    double A[3];                // Cone axis, unit length
+    double a;                   // Cone half-angle in radians, or zero
+    double r0;                  // Radius of sample value 0
+    double r1;                  // Radius of sample value 1
+    double k;                   // Pixels per unit length at unit distance
+    double e;                   // Target pixels per sample
+} scm_view;
+
+bool      scm_scan_bounds(scm *);
+long long scm_visible    (scm *, const scm_view *, long long *, long long);
 
 //------------------------------------------------------------------------------
 
@@ -11,6 +11,7 @@
 // more details.
 
 #include <stdint.h>
+#include <string.h>
 #include <stdio.h>
 #include <zlib.h>
 
@@ -333,23 +334,37 @@ void fromdif(scm *s, uint8_t *bin, int i)
         dehdif(bin + j * d, n, s->c, s->b);
 }
 
-// Compress or decompress rows i through i+r.
+// Compress or decompress rows i through i+r. Compression 1 stores the rows
+// verbatim and compression 8 deflates them at level k.
 
-void tozip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t *c)
+void tozip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t *c,
+                                        uint16_t  z,  int       k)
 {
     uLong l = (uLong) ((s->n + 2) * min(s->r, s->n + 2 - i) * s->c * s->b / 8);
-    uLong z = compressBound(l);
+    uLong n = compressBound(l);
 
-    compress((Bytef *) zip, &z, (const Bytef *) bin, l);
-    *c = (uint32_t) z;
+    if (z == 1)
+    {
+        memcpy(zip, bin, (size_t) l);
+        *c = (uint32_t) l;
+    }
+    else
+    {
+        compress2((Bytef *) zip, &n, (const Bytef *) bin, l, k);
+        *c = (uint32_t) n;
+    }
 }
 
-void fromzip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t c)
+void fromzip(scm *s, uint8_t *bin, int i, uint8_t *zip, uint32_t c,
+                                          uint16_t z)
 {
     uLong l = (uLong) ((s->n + 2) * min(s->r, s->n + 2 - i) * s->c * s->b / 8);
-    uLong z = (uLong) c;
+    uLong n = (uLong) c;
 
-    uncompress((Bytef *) bin, &l, (const Bytef *) zip, z);
+    if (z == 1)
+        memcpy(bin, zip, (size_t) min(l, n));
+    else
+        uncompress((Bytef *) bin, &l, (const Bytef *) zip, n);
 }
 
 //------------------------------------------------------------------------------
@@ -25,6 +25,7 @@ typedef struct header header;
 typedef struct field  field;
 typedef struct hfd    hfd;
 typedef struct ifd    ifd;
+typedef struct bounds bounds;
 
 #define SCM_HFD_COUNT    13
 #define SCM_IFD_COUNT    14
@@ -33,6 +34,14 @@ typedef struct ifd    ifd;
 #define SCM_PAGE_MINIMUM 0xFFB3
 #define SCM_PAGE_MAXIMUM 0xFFB4
 
+// Each page may be followed by a private block of bounds, giving the min and
+// max of each channel over a quadtree of sub-pages to depth SCM_BOUNDS_DEPTH.
+// This lets the bounding of a finished file skip decoding the page data.
+
+#define SCM_BOUNDS_MAGIC 0x58424353
+#define SCM_BOUNDS_DEPTH 3
+#define SCM_BOUNDS_COUNT 85
+
 #pragma pack(push)
 #pragma pack(2)
 
@@ -96,12 +105,81 @@ struct ifd
     uint64_t next;
 };
 
+struct bounds
+{
+    uint32_t magic;             // SCM_BOUNDS_MAGIC
+    uint16_t depth;             // SCM_BOUNDS_DEPTH
+    uint16_t channels;          // Channel count
+
+    // Followed by min and max of each channel of SCM_BOUNDS_COUNT sub-pages.
+};
+
 #pragma pack(pop)
 
 //------------------------------------------------------------------------------
 
 typedef struct { long long x; long long o; } scm_pair;
 
+// A page codec gives the TIFF predictor, the TIFF compression, and the deflate
+// level. Adaptive policies choose among SCM_CODEC_COUNT candidates per page.
+
+typedef struct { uint16_t p; uint16_t z; int l; } scm_codec;
+
+// An SCM collection is a text manifest beginning with SCM_MANIFEST and listing
+// one shard file per line. Catalog offsets of a collection give the shard in
+// the bits above SCM_SHARD_SHIFT.
+
+#define SCM_MANIFEST    "SCMTIFF COLLECTION"
+#define SCM_SHARD_SHIFT 56
+
+// An occupancy index maps page indices to catalog positions. Each level that
+// is dense enough is a bit vector over all pages of that level, stored in
+// cache-line blocks of 448 bits with the rank of the block's first bit. Other
+// levels fall back to searching their span of the sorted index array.
+
+#define SCM_OCC_LEVELS 32
+
+typedef struct { uint64_t r; uint64_t w[7]; } scm_block;
+
+typedef struct
+{
+    long long i;                // Catalog position of the first page of level
+    long long n;                // Number of pages present at level
+    long long b;                // First block of level, or -1 if sparse
+} scm_level;
+
+typedef struct
+{
+    int              lc;        // Level count
+    scm_level        lv[SCM_OCC_LEVELS];
+    scm_block       *bv;        // Block array of all dense levels
+    long long        xc;        // Sorted index array length
+    const long long *xv;        // Sorted index array
+} scm_occ;
+
+// A page iterator visits the catalog of an SCM in file order or level order,
+// advising the system to read ahead the data of the next k pages.
+
+#define SCM_ORDER_FILE  0
+#define SCM_ORDER_LEVEL 1
+#define SCM_READ_AHEAD  8
+
+typedef struct
+{
+    struct scm *s;              // Cataloged SCM
+    int         k;              // Read-ahead page count
+    long long   c;              // Catalog length
+    long long   i;              // Next iteration position
+    long long   a;              // Read-ahead iteration position
+    long long  *pv;             // Catalog position of each iteration
+    long long  *ev;             // End offset of the data of each catalog page
+} scm_iter;
+
+#define SCM_CODEC_FIXED 0
+#define SCM_CODEC_SIZE  1
+#define SCM_CODEC_SPEED 2
+#define SCM_CODEC_COUNT 7
+
 struct scm
 {
     char *name;                 // File name
@@ -117,9 +195,30 @@ struct scm
     long long *xv;
     long long  oc;
     long long *ov;
+    scm_occ    xq;              // Occupancy index of xv
+
+    long long  yc;              // Finished catalog length
+    long long *yv;              // Finished catalog page indices
+    float     *av;              // Finished catalog page minima
+    float     *zv;              // Finished catalog page maxima
+    scm_occ    yq;              // Occupancy index of yv
+    long long  rc;              // Finished catalog root count
+    long long *rv;              // Finished catalog pages without parent
+
+    long long  ho;              // Offset of space reserved for metadata
+    long long  hn;              // Length of space reserved for metadata
 
     uint8_t **binv;             // Strip bin scratch buffer pointers
     uint8_t **zipv;             // Strip zip scratch buffer pointers
+    float    *boundv;           // Page bounds scratch buffer
+
+    int z;                      // Codec selection policy
+
+    long long zn[SCM_CODEC_COUNT];  // Pages written with each codec
+    long long zb[SCM_CODEC_COUNT];  // Bytes written with each codec
+
+    int         sc;             // Shard count of a collection
+    struct scm **sv;            // Shard pointers of a collection
 };
 
 typedef struct scm scm;
@@ -153,8 +252,8 @@ void frombin(scm *, const uint8_t *, float *, int);
 void   todif(scm *s, uint8_t *, int);
 void fromdif(scm *s, uint8_t *, int);
 
-void   tozip(scm *, uint8_t *, int, uint8_t *, uint32_t *);
-void fromzip(scm *, uint8_t *, int, uint8_t *, uint32_t);
+void   tozip(scm *, uint8_t *, int, uint8_t *, uint32_t *, uint16_t, int);
+void fromzip(scm *, uint8_t *, int, uint8_t *, uint32_t,   uint16_t);
 
 //------------------------------------------------------------------------------
 
@@ -44,24 +44,146 @@ void scm_vector(long long f, double y, double x, double *v)
     }
 }
 
+// Calculate an h-by-w grid of vectors on root face f. Row i column j gives the
+// vector toward ((c + j + o) / n, (r + i + o) / n). The mapping is separable,
+// so the trigonometry is tabulated once per row and once per column.
+
+void scm_vector_grid(long long f, long long r, long long c, long long n,
+                     long long h, long long w, double o, double *v)
+{
+    static const int    P[6][3] = {
+        { 2, 1, 0 }, { 2, 1, 0 }, { 0, 2, 1 },
+        { 0, 2, 1 }, { 0, 1, 2 }, { 0, 1, 2 }
+    };
+    static const double S[6][3] = {
+        { 1.0, 1.0, -1.0 }, { -1.0, 1.0, 1.0 }, { 1.0, 1.0, -1.0 },
+        { 1.0, -1.0, 1.0 }, {  1.0, 1.0, 1.0 }, { -1.0, 1.0, -1.0 }
+    };
+
+    const int    p0 = P[f][0], p1 = P[f][1], p2 = P[f][2];
+    const double s0 = S[f][0], s1 = S[f][1], s2 = S[f][2];
+
+    long long i;
+    long long j;
+
+    // Tabulate the column sines and cosines in the first row of the grid.
+
+    for (j = 0; j < w; j++)
+    {
+        const double x = ((double) (c + j) + o) / n;
+        const double s = x * M_PI / 2.0 - M_PI / 4.0;
+
+        v[j * 3 + 0] = sin(s);
+        v[j * 3 + 1] = cos(s);
+    }
+
+    // Fill the rows last to first, so the table is overwritten last of all.
+
+    for (i = h - 1; i >= 0; i--)
+    {
+        const double y = ((double) (r + i) + o) / n;
+        const double t = y * M_PI / 2.0 - M_PI / 4.0;
+        const double st = sin(t);
+        const double ct = cos(t);
+
+        double *q = v + i * w * 3;
+
+        for (j = 0; j < w; j++)
+        {
+            const double ss = v[j * 3 + 0];
+            const double cs = v[j * 3 + 1];
+
+            double u[3];
+
+            u[0] =  ss * ct;
+            u[1] = -cs * st;
+            u[2] =  cs * ct;
+
+            double k = 1.0 / sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+
+            u[0] *= k;
+            u[1] *= k;
+            u[2] *= k;
+
+            q[j * 3 + 0] = s0 * u[p0];
+            q[j * 3 + 1] = s1 * u[p1];
+            q[j * 3 + 2] = s2 * u[p2];
+        }
+    }
+}
+
+// Step root f row r column c one page north. ----------------------------------
+
+static inline void step_north(long long *f, long long *r, long long *c,
+                                                          long long  m)
+{
+    const long long t = m - *c;
+
+    if      (*r >  0) {         *r = *r - 1;      }
+    else if (*f == 0) { *f = 2; *r = t;  *c = m;  }
+    else if (*f == 1) { *f = 2; *r = *c; *c = 0;  }
+    else if (*f == 2) { *f = 5; *r = 0;  *c = t;  }
+    else if (*f == 3) { *f = 4; *r = m;           }
+    else if (*f == 4) { *f = 2; *r = m;           }
+    else              { *f = 2; *r = 0;  *c = t;  }
+}
+
+// Step root f row r column c one page south. ----------------------------------
+
+static inline void step_south(long long *f, long long *r, long long *c,
+                                                          long long  m)
+{
+    const long long t = m - *c;
+
+    if      (*r <  m) {         *r = *r + 1;      }
+    else if (*f == 0) { *f = 3; *r = *c; *c = m;  }
+    else if (*f == 1) { *f = 3; *r = t;  *c = 0;  }
+    else if (*f == 2) { *f = 4; *r = 0;           }
+    else if (*f == 3) { *f = 5; *r = m;  *c = t;  }
+    else if (*f == 4) { *f = 3; *r = 0;           }
+    else              { *f = 3; *r = m;  *c = t;  }
+}
+
+// Step root f row r column c one page west. -----------------------------------
+
+static inline void step_west(long long *f, long long *r, long long *c,
+                                                         long long  m)
+{
+    const long long t = m - *r;
+
+    if      (*c >  0) {         *c = *c - 1;      }
+    else if (*f == 0) { *f = 4; *c = m;           }
+    else if (*f == 1) { *f = 5; *c = m;           }
+    else if (*f == 2) { *f = 1; *c = *r; *r = 0;  }
+    else if (*f == 3) { *f = 1; *c = t;  *r = m;  }
+    else if (*f == 4) { *f = 1; *c = m;           }
+    else              { *f = 0; *c = m;           }
+}
+
+// Step root f row r column c one page east. -----------------------------------
+
+static inline void step_east(long long *f, long long *r, long long *c,
+                                                         long long  m)
+{
+    const long long t = m - *r;
+
+    if      (*c <  m) {         *c = *c + 1;      }
+    else if (*f == 0) { *f = 5; *c = 0;           }
+    else if (*f == 1) { *f = 4; *c = 0;           }
+    else if (*f == 2) { *f = 0; *c = t;  *r = 0;  }
+    else if (*f == 3) { *f = 0; *c = *r; *r = m;  }
+    else if (*f == 4) { *f = 0; *c = 0;           }
+    else              { *f = 1; *c = 0;           }
+}
+
 // Determine the page to the north of page i. ----------------------------------
 
 long long scm_page_north(long long i)
 {
-    long long l = scm_page_level(i);
-    long long f = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    long long f, l, r, c;
 
-    long long n = 1LL << l, m = n - 1, t = m - c;
-
-    if      (r >  0) {        r = r - 1;    }
-    else if (f == 0) { f = 2; r = t; c = m; }
-    else if (f == 1) { f = 2; r = c; c = 0; }
-    else if (f == 2) { f = 5; r = 0; c = t; }
-    else if (f == 3) { f = 4; r = m;        }
-    else if (f == 4) { f = 2; r = m;        }
-    else             { f = 2; r = 0; c = t; }
+    scm_page_decode(i, &f, &l, &r, &c);
+    step_north(&f, &r, &c, (1LL << l) - 1);
 
     return scm_page_index(f, l, r, c);
 }
@@ -70,20 +192,10 @@ long long scm_page_north(long long i)
 
 long long scm_page_south(long long i)
 {
-    long long l = scm_page_level(i);
-    long long f = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    long long f, l, r, c;
 
-    long long n = 1LL << l, m = n - 1, t = m - c;
-
-    if      (r <  m) {        r = r + 1;    }
-    else if (f == 0) { f = 3; r = c; c = m; }
-    else if (f == 1) { f = 3; r = t; c = 0; }
-    else if (f == 2) { f = 4; r = 0;        }
-    else if (f == 3) { f = 5; r = m; c = t; }
-    else if (f == 4) { f = 3; r = 0;        }
-    else             { f = 3; r = m; c = t; }
+    scm_page_decode(i, &f, &l, &r, &c);
+    step_south(&f, &r, &c, (1LL << l) - 1);
 
     return scm_page_index(f, l, r, c);
 }
@@ -92,20 +204,10 @@ long long scm_page_south(long long i)
 
 long long scm_page_west(long long i)
 {
-    long long l = scm_page_level(i);
-    long long f = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
-
-    long long n = 1LL << l, m = n - 1, t = m - r;
+    long long f, l, r, c;
 
-    if      (c >  0) {        c = c - 1;    }
-    else if (f == 0) { f = 4; c = m;        }
-    else if (f == 1) { f = 5; c = m;        }
-    else if (f == 2) { f = 1; c = r; r = 0; }
-    else if (f == 3) { f = 1; c = t; r = m; }
-    else if (f == 4) { f = 1; c = m;        }
-    else             { f = 0; c = m;        }
+    scm_page_decode(i, &f, &l, &r, &c);
+    step_west(&f, &r, &c, (1LL << l) - 1);
 
     return scm_page_index(f, l, r, c);
 }
@@ -114,24 +216,103 @@ long long scm_page_west(long long i)
 
 long long scm_page_east(long long i)
 {
-    long long l = scm_page_level(i);
-    long long f = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
-
-    long long n = 1LL << l, m = n - 1, t = m - r;
+    long long f, l, r, c;
 
-    if      (c <  m) {        c = c + 1;    }
-    else if (f == 0) { f = 5; c = 0;        }
-    else if (f == 1) { f = 4; c = 0;        }
-    else if (f == 2) { f = 0; c = t; r = 0; }
-    else if (f == 3) { f = 0; c = r; r = m; }
-    else if (f == 4) { f = 0; c = 0;        }
-    else             { f = 1; c = 0;        }
+    scm_page_decode(i, &f, &l, &r, &c);
+    step_east(&f, &r, &c, (1LL << l) - 1);
 
     return scm_page_index(f, l, r, c);
 }
 
+// Determine all eight neighbors of page i. ------------------------------------
+
+void scm_page_neighbors(long long i, long long *v)
+{
+    // Neighbors are given in the order N, S, W, E, NW, NE, SW, SE. Diagonals
+    // step first within the root of page i where they can, as a diagonal across
+    // a cube corner is ambiguous.
+
+    long long f, l, r, c;
+
+    scm_page_decode(i, &f, &l, &r, &c);
+
+    const long long m = (1LL << l) - 1;
+
+    long long fn = f, rn = r, cn = c;
+    long long fs = f, rs = r, cs = c;
+    long long fw = f, rw = r, cw = c;
+    long long fe = f, re = r, ce = c;
+
+    step_north(&fn, &rn, &cn, m);
+    step_south(&fs, &rs, &cs, m);
+    step_west (&fw, &rw, &cw, m);
+    step_east (&fe, &re, &ce, m);
+
+    v[0] = scm_page_index(fn, l, rn, cn);
+    v[1] = scm_page_index(fs, l, rs, cs);
+    v[2] = scm_page_index(fw, l, rw, cw);
+    v[3] = scm_page_index(fe, l, re, ce);
+
+    if (fn == f)
+    {
+        long long f0 = fn, r0 = rn, c0 = cn;
+        long long f1 = fn, r1 = rn, c1 = cn;
+
+        step_west(&f0, &r0, &c0, m);
+        step_east(&f1, &r1, &c1, m);
+
+        v[4] = scm_page_index(f0, l, r0, c0);
+        v[5] = scm_page_index(f1, l, r1, c1);
+    }
+    else
+    {
+        step_north(&fw, &rw, &cw, m);
+        step_north(&fe, &re, &ce, m);
+
+        v[4] = scm_page_index(fw, l, rw, cw);
+        v[5] = scm_page_index(fe, l, re, ce);
+
+        fw = f; rw = r; cw = c; step_west(&fw, &rw, &cw, m);
+        fe = f; re = r; ce = c; step_east(&fe, &re, &ce, m);
+    }
+
+    if (fs == f)
+    {
+        long long f0 = fs, r0 = rs, c0 = cs;
+        long long f1 = fs, r1 = rs, c1 = cs;
+
+        step_west(&f0, &r0, &c0, m);
+        step_east(&f1, &r1, &c1, m);
+
+        v[6] = scm_page_index(f0, l, r0, c0);
+        v[7] = scm_page_index(f1, l, r1, c1);
+    }
+    else
+    {
+        step_south(&fw, &rw, &cw, m);
+        step_south(&fe, &re, &ce, m);
+
+        v[6] = scm_page_index(fw, l, rw, cw);
+        v[7] = scm_page_index(fe, l, re, ce);
+    }
+}
+
+// Calculate the four children of each of n pages. -----------------------------
+
+void scm_page_children_n(long long n, const long long *x, long long *v)
+{
+    for (long long i = 0; i < n; i++)
+        scm_page_children(x[i], v + i * 4);
+}
+
+// Determine the eight neighbors of each of n pages. ---------------------------
+
+void scm_page_neighbors_n(long long n, const long long *x, long long *v)
+{
+    for (long long i = 0; i < n; i++)
+        scm_page_neighbors(x[i], v + i * 8);
+}
+
 // Calculate the four corner vectors of page i. --------------------------------
 
 void scm_page_corners(long long i, double *v)
@@ -116,15 +116,50 @@ static inline long long scm_page_order(long long i)
              + (scm_page_col(i) % 2);
 }
 
+// Decode page i into its root f, level l, row r, and column c. ----------------
+
+static inline void scm_page_decode(long long i, long long *f, long long *l,
+                                                long long *r, long long *c)
+{
+    const long long k = scm_page_level(i);
+    const long long n = 1LL << (2 * k);
+    const long long a = i - 2 * (n - 1);
+
+    *f = a / n;
+    *l = k;
+    *r = (a % n) >> k;
+    *c = (a % n) & ((1LL << k) - 1);
+}
+
+// Calculate all four children of page i, in child order. ----------------------
+
+static inline void scm_page_children(long long i, long long *v)
+{
+    long long f, l, r, c;
+
+    scm_page_decode(i, &f, &l, &r, &c);
+
+    v[0] = scm_page_index(f, l + 1, r * 2, c * 2);
+    v[1] = v[0] + 1;
+    v[2] = v[0] + (2LL << l);
+    v[3] = v[2] + 1;
+}
+
 //------------------------------------------------------------------------------
 
-void scm_vector(long long, double, double, double *);
+void scm_vector     (long long, double, double, double *);
+void scm_vector_grid(long long, long long, long long, long long,
+                                long long, long long, double, double *);
 
 long long scm_page_north(long long);
 long long scm_page_south(long long);
 long long scm_page_west (long long);
 long long scm_page_east (long long);
 
+void scm_page_neighbors  (long long, long long *);
+void scm_page_children_n (long long, const long long *, long long *);
+void scm_page_neighbors_n(long long, const long long *, long long *);
+
 void scm_page_corners(long long, double *);
 
 //------------------------------------------------------------------------------
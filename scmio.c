@@ -10,10 +10,19 @@
 // FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
 // more details.
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#include <unistd.h>
+#include <fcntl.h>
+#else
+#include <io.h>
+#endif
+
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <float.h>
 #include <zlib.h>
 
 #include "scmdat.h"
@@ -23,7 +32,7 @@
 
 //------------------------------------------------------------------------------
 
-// Allocate properly-sized bin and zip scratch buffers for SCM s.
+// Allocate properly-sized bin, zip, and bounds scratch buffers for SCM s.
 
 bool scm_alloc(scm *s)
 {
@@ -34,7 +43,9 @@ bool scm_alloc(scm *s)
     size_t c = (size_t) (s->n + 2 + s->r - 1) / (size_t) s->r;
 
     if ((s->binv = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
-        (s->zipv = (uint8_t **) calloc(c, sizeof (uint8_t *))))
+        (s->zipv = (uint8_t **) calloc(c, sizeof (uint8_t *))) &&
+        (s->boundv = (float *) calloc(SCM_BOUNDS_COUNT * 2 * (size_t) s->c,
+                                                          sizeof (float))))
     {
         for (size_t i = 0; i < c; i++)
         {
@@ -46,7 +57,7 @@ bool scm_alloc(scm *s)
     return false;
 }
 
-// Free the bin and zip scratch buffers.
+// Free the bin, zip, and bounds scratch buffers.
 
 void scm_free(scm *s)
 {
@@ -60,11 +71,13 @@ void scm_free(scm *s)
             if (s->binv) free(s->binv[i]);
         }
     }
+    free(s->boundv);
     free(s->zipv);
     free(s->binv);
 
-    s->zipv = NULL;
-    s->binv = NULL;
+    s->boundv = NULL;
+    s->zipv   = NULL;
+    s->binv   = NULL;
 }
 
 //------------------------------------------------------------------------------
@@ -100,6 +113,16 @@ bool scm_seek(scm *s, long long o)
     return false;
 }
 
+// Advise the system that n bytes at offset o of SCM s will soon be read, so that
+// it may begin reading them ahead. A length of zero extends to the end of file.
+
+void scm_advise(scm *s, long long o, long long n)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fileno(s->fp), (off_t) o, (off_t) n, POSIX_FADV_WILLNEED);
+#endif
+}
+
 // Read from the SCM file at the given offset, to the given buffer.
 
 bool scm_read(scm *s, void *ptr, size_t len, long long o)
@@ -162,6 +185,44 @@ long long scm_align(scm *s)
     return -1;
 }
 
+// Return the length of the SCM file, leaving the file pointer at its end.
+
+long long scm_length(scm *s)
+{
+    long long o;
+
+    if (scm_ffwd(s))
+    {
+        if ((o = ftello(s->fp)) >= 0)
+        {
+            return o;
+        }
+        else syserr("Failed to tell SCM");
+    }
+    return -1;
+}
+
+// Truncate the SCM file at offset o, discarding everything that follows.
+
+bool scm_trunc(scm *s, long long o)
+{
+    if (fflush(s->fp) == 0)
+    {
+#ifdef _WIN32
+        if (_chsize_s(_fileno(s->fp), o) == 0)
+#else
+        if (ftruncate(fileno(s->fp), (off_t) o) == 0)
+#endif
+        {
+            return true;
+        }
+        else syserr("Failed to truncate SCM");
+    }
+    else syserr("Failed to flush SCM");
+
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 // Initialize an SCM TIFF field.
@@ -492,11 +553,14 @@ bool scm_write_zips(scm *s, uint8_t **zv,
 
 //------------------------------------------------------------------------------
 
-// Read and decode a page of data to the given float buffer.
+// Read and decode a page of data to the given float buffer. Predictor pr and
+// compression co are given by the page's IFD.
 
 bool scm_read_data(scm *s, float *p, uint64_t oo,
                                      uint64_t lo,
-                                     uint16_t sc)
+                                     uint16_t sc,
+                                     uint16_t pr,
+                                     uint16_t co)
 {
     // Strip count and rows-per-strip are given by the IFD.
 
@@ -511,7 +575,8 @@ bool scm_read_data(scm *s, float *p, uint64_t oo,
         #pragma omp parallel for
         for (i = 0; i < c; i++)
         {
-            fromzip(s, s->binv[i],    i * s->r, s->zipv[i], l[i]);
+            fromzip(s, s->binv[i],    i * s->r, s->zipv[i], l[i], co);
+            if (pr == 2)
             fromdif(s, s->binv[i],    i * s->r);
             frombin(s, s->binv[i], p, i * s->r);
         }
@@ -520,33 +585,252 @@ bool scm_read_data(scm *s, float *p, uint64_t oo,
     return false;
 }
 
-// Encode and write a page of data from the given float buffer.
+//------------------------------------------------------------------------------
+
+// Candidate codecs of the adaptive policies, ordered by increasing decode cost.
+
+static const scm_codec codecs[SCM_CODEC_COUNT] = {
+    { 1, 1, 0 },
+    { 1, 8, 1 },
+    { 1, 8, 6 },
+    { 1, 8, 9 },
+    { 2, 8, 1 },
+    { 2, 8, 6 },
+    { 2, 8, 9 },
+};
+
+// The speed policy accepts a codec that is cheaper to decode than the smallest
+// if its trial size is within this fraction of the smallest.
+
+#define SCM_CODEC_SLACK 0.1
+
+// Trial-compress a sample of the strips of page p with each candidate codec and
+// return the index of the candidate preferred by the policy of SCM s. The trial
+// leaves the bin and zip scratch buffers of the sampled strips dirty.
+
+static int scm_select(scm *s, const float *p)
+{
+    const int c = (s->n + 2 + s->r - 1) / s->r;
+    const int m = min(c, 4);
+
+    long long z[4][SCM_CODEC_COUNT];
+    long long t[SCM_CODEC_COUNT];
+    int i, k, b = 0;
+
+    // Trial each candidate on m evenly-spaced strips. Candidates without the
+    // predictor come first, so the difference may then be applied in place.
+
+    #pragma omp parallel for private(k)
+    for (i = 0; i < m; i++)
+    {
+        const int j = (2 * i + 1) * c / (2 * m);
+        uint32_t  l;
+
+        tobin(s, s->binv[j], p, j * s->r);
+
+        for (k = 0; k < SCM_CODEC_COUNT; k++)
+        {
+            if (codecs[k].p == 2 && codecs[k - 1].p != 2)
+                todif(s, s->binv[j], j * s->r);
+
+            if (codecs[k].p == 2 && scm_hdif(s) != 2)
+                z[i][k] = -1;
+            else
+            {
+                tozip(s, s->binv[j], j * s->r, s->zipv[j], &l, codecs[k].z,
+                                                               codecs[k].l);
+                z[i][k] = (long long) l;
+            }
+        }
+    }
+
+    // Total the trial sizes and find the smallest.
+
+    for (k = 0; k < SCM_CODEC_COUNT; k++)
+    {
+        for (t[k] = 0, i = 0; i < m; i++)
+            t[k] = (z[i][k] < 0 || t[k] < 0) ? -1 : t[k] + z[i][k];
+
+        if (t[k] >= 0 && t[k] < t[b])
+            b = k;
+    }
+
+    // Under the speed policy, take the cheapest codec that's nearly as small.
+
+    if (s->z == SCM_CODEC_SPEED)
+        for (k = 0; k < b; k++)
+            if (t[k] >= 0 && t[k] <= (long long) (t[b] * (1.0 + SCM_CODEC_SLACK)))
+                return k;
+
+    return b;
+}
+
+// Encode and write a page of data from the given float buffer. Return the
+// codec used in e.
 
 bool scm_write_data(scm *s, const float *p, uint64_t *oo,
                                             uint64_t *lo,
-                                            uint16_t *sc)
+                                            uint16_t *sc,
+                                            scm_codec *e)
 {
     // Strip count is total rows / rows-per-strip rounded up.
 
-    int i, c = (s->n + 2 + s->r - 1) / s->r;
+    int i, k = -1, c = (s->n + 2 + s->r - 1) / s->r;
     uint64_t o[256];
     uint32_t l[256];
 
+    // Choose the codec of this page.
+
+    if (s->z == SCM_CODEC_FIXED)
+    {
+        e->p = (uint16_t) scm_hdif(s);
+        e->z = 8;
+        e->l = Z_DEFAULT_COMPRESSION;
+    }
+    else
+        *e = codecs[(k = scm_select(s, p))];
+
     // Encode each strip for writing. This is our hot spot.
 
     #pragma omp parallel for
     for (i = 0; i < c; i++)
     {
         tobin(s, s->binv[i], p, i * s->r);
+        if (e->p == 2)
         todif(s, s->binv[i],    i * s->r);
-        tozip(s, s->binv[i],    i * s->r, s->zipv[i], l + i);
+        tozip(s, s->binv[i],    i * s->r, s->zipv[i], l + i, e->z, e->l);
     }
 
     *sc = (uint16_t) c;
 
+    // Note the codec statistics.
+
+    if (k >= 0)
+    {
+        s->zn[k] += 1;
+
+        for (i = 0; i < c; i++)
+            s->zb[k] += l[i];
+    }
+
     return scm_write_zips(s, s->zipv, oo, lo, sc, o, l);
 }
 
+// Report the number of pages and bytes written using each codec.
+
+void scm_report(scm *s)
+{
+    for (int k = 0; k < SCM_CODEC_COUNT; k++)
+        if (s->zn[k])
+            printf("%s: predictor %d compression %d level %d:"
+                   " %lld pages %lld bytes\n", s->name, codecs[k].p,
+                                                        codecs[k].z,
+                                                        codecs[k].l,
+                                              s->zn[k], s->zb[k]);
+}
+
+//------------------------------------------------------------------------------
+
+// Note in e the extrema of sub-page j of level k, covering pixels l through r
+// and t through b of page p. Subdivide as does the bounding of scm_finish.
+
+static void scm_bound_quad(scm *s, const float *p, float *e, int k,
+                                   long long j, int l, int r, int t, int b)
+{
+    float *d = e + (((1LL << (2 * k)) - 1) / 3 + j) * s->c * 2;
+
+    for (int i = 0; i < s->c; ++i)
+    {
+        d[i * 2 + 0] =  FLT_MAX;
+        d[i * 2 + 1] = -FLT_MAX;
+    }
+
+    if (k < SCM_BOUNDS_DEPTH)
+    {
+        int h = (l + r) / 2;
+        int v = (b + t) / 2;
+
+        scm_bound_quad(s, p, e, k + 1, j * 4 + 0, l, h, t, v);
+        scm_bound_quad(s, p, e, k + 1, j * 4 + 1, h, r, t, v);
+        scm_bound_quad(s, p, e, k + 1, j * 4 + 2, l, h, v, b);
+        scm_bound_quad(s, p, e, k + 1, j * 4 + 3, h, r, v, b);
+
+        for (int q = 0; q < 4; ++q)
+        {
+            const float *c = e + (((1LL << (2 * k + 2)) - 1) / 3 + j * 4 + q)
+                                                                * s->c * 2;
+            for (int i = 0; i < s->c; ++i)
+            {
+                if (d[i * 2 + 0] > c[i * 2 + 0]) d[i * 2 + 0] = c[i * 2 + 0];
+                if (d[i * 2 + 1] < c[i * 2 + 1]) d[i * 2 + 1] = c[i * 2 + 1];
+            }
+        }
+    }
+    else
+    {
+        for     (int y = t; y < b; ++y)
+            for (int x = l; x < r; ++x)
+            {
+                const float *c = p + ((y + 1) * (s->n + 2) + (x + 1)) * s->c;
+
+                for (int i = 0; i < s->c; ++i)
+                {
+                    if (d[i * 2 + 0] > c[i]) d[i * 2 + 0] = c[i];
+                    if (d[i * 2 + 1] < c[i]) d[i * 2 + 1] = c[i];
+                }
+            }
+    }
+}
+
+// Compute the bounds of page p, giving the min and max of each channel of all
+// sub-pages to depth SCM_BOUNDS_DEPTH in breadth-first order.
+
+void scm_page_bounds(scm *s, const float *p, float *e)
+{
+    scm_bound_quad(s, p, e, 0, 0, 0, s->n, 0, s->n);
+}
+
+// Write page bounds e at the current file position, which must immediately
+// follow the strip length array of the page.
+
+bool scm_write_bounds(scm *s, const float *e)
+{
+    bounds h;
+
+    h.magic    = SCM_BOUNDS_MAGIC;
+    h.depth    = SCM_BOUNDS_DEPTH;
+    h.channels = (uint16_t) s->c;
+
+    if (scm_write(s, &h, sizeof (bounds)) > 0)
+        if (scm_write(s, e, SCM_BOUNDS_COUNT * 2 * (size_t) s->c
+                                                 * sizeof (float)) > 0)
+            return true;
+
+    return false;
+}
+
+// Read the bounds of the page with strip length array at offset lo and strip
+// count sc. Return false if the page was written without bounds.
+
+bool scm_read_bounds(scm *s, uint64_t lo, uint16_t sc, float *e)
+{
+    long long o = (long long) (lo + sc * sizeof (uint32_t));
+    bounds    h;
+
+    if (fseeko(s->fp, o, SEEK_SET) == 0 &&
+        fread(&h, sizeof (bounds), 1, s->fp) == 1)
+    {
+        if (h.magic    == SCM_BOUNDS_MAGIC &&
+            h.depth    == SCM_BOUNDS_DEPTH &&
+            h.channels == (uint16_t) s->c)
+
+            return scm_read(s, e, SCM_BOUNDS_COUNT * 2 * (size_t) s->c
+                                                        * sizeof (float),
+                                                  o + sizeof (bounds));
+    }
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 // Set IFD c to be the "next" of IFD p. If p is zero, set IFD c to be the first
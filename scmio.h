@@ -27,9 +27,12 @@ void      scm_free (scm *);
 
 bool      scm_ffwd (scm *);
 bool      scm_seek (scm *,                       long long);
+void      scm_advise(scm *,           long long, long long);
 bool      scm_read (scm *,       void *, size_t, long long);
 long long scm_write(scm *, const void *, size_t);
 long long scm_align(scm *);
+long long scm_length(scm *);
+bool      scm_trunc(scm *, long long);
 
 //------------------------------------------------------------------------------
 
@@ -57,8 +60,16 @@ bool scm_read_zips (scm *, uint8_t **, uint64_t,   uint64_t,   uint16_t,
 bool scm_write_zips(scm *, uint8_t **, uint64_t *, uint64_t *, uint16_t *,
                                                    uint64_t *, uint32_t *);
 
-bool scm_read_data (scm *,       float *, uint64_t,   uint64_t,   uint16_t);
-bool scm_write_data(scm *, const float *, uint64_t *, uint64_t *, uint16_t *);
+bool scm_read_data (scm *,       float *, uint64_t,   uint64_t,   uint16_t,
+                                                   uint16_t,   uint16_t);
+bool scm_write_data(scm *, const float *, uint64_t *, uint64_t *, uint16_t *,
+                                                                  scm_codec *);
+
+void scm_report    (scm *);
+
+void scm_page_bounds (scm *, const float *, float *);
+bool scm_write_bounds(scm *, const float *);
+bool scm_read_bounds (scm *, uint64_t, uint16_t, float *);
 
 //------------------------------------------------------------------------------
 
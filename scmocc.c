@@ -0,0 +1,212 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "scmdef.h"
+#include "scmdat.h"
+#include "scmocc.h"
+
+//------------------------------------------------------------------------------
+
+// A level receives a bit vector if that costs no more than SCM_OCC_DENSITY bits
+// per page present. Sparser levels are searched, as they cost little to search.
+
+#define SCM_OCC_DENSITY 32
+#define SCM_BLOCK_BITS  448
+
+static inline int popcount(uint64_t v)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(v);
+#else
+    v =  v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Calculate the number of pages at level l.
+
+static inline long long level_size(long long l)
+{
+    return 6LL << (2 * l);
+}
+
+// Return the block and bit holding page x of level l.
+
+static inline scm_block *locate(const scm_occ *q, long long x, long long l,
+                                                               int *k)
+{
+    const long long j = x - scm_page_count(l - 1);
+
+    *k = (int) (j % SCM_BLOCK_BITS);
+
+    return q->bv + q->lv[l].b + j / SCM_BLOCK_BITS;
+}
+
+//------------------------------------------------------------------------------
+
+// Initialize occupancy index q of the sorted index array v of length c. The
+// index refers to v but does not copy it. All bit vectors share one allocation.
+
+bool scm_occ_init(scm_occ *q, long long c, const long long *v)
+{
+    long long i;
+    long long l;
+    long long m = 0;
+
+    memset(q, 0, sizeof (scm_occ));
+
+    q->xc = c;
+    q->xv = v;
+
+    // Determine the span of each level within the sorted index array.
+
+    for (i = 0; i < c; i++)
+    {
+        if ((l = scm_page_level(v[i])) >= SCM_OCC_LEVELS - 1)
+            return false;
+
+        if (q->lv[l].n++ == 0)
+            q->lv[l].i = i;
+
+        q->lc = (int) l + 1;
+    }
+
+    // Choose the representation of each level and count the blocks needed.
+
+    for (l = 0; l < q->lc; l++)
+    {
+        long long k = (level_size(l) + SCM_BLOCK_BITS - 1) / SCM_BLOCK_BITS;
+
+        if (q->lv[l].n && k * (long long) sizeof (scm_block) * 8
+                                  <= SCM_OCC_DENSITY * q->lv[l].n)
+        {
+            q->lv[l].b = m;
+            m += k;
+        }
+        else q->lv[l].b = -1;
+    }
+
+    // Set the bit of each present page and accumulate the rank of each block.
+
+    if (m)
+    {
+        if ((q->bv = (scm_block *) calloc((size_t) m, sizeof (scm_block))))
+        {
+            for (i = 0; i < c; i++)
+                if (q->lv[l = scm_page_level(v[i])].b >= 0)
+                {
+                    int        k;
+                    scm_block *b = locate(q, v[i], l, &k);
+
+                    b->w[k / 64] |= 1ULL << (k % 64);
+                }
+
+            for (l = 0; l < q->lc; l++)
+                if (q->lv[l].b >= 0)
+                {
+                    long long k = (level_size(l) + SCM_BLOCK_BITS - 1)
+                                                 / SCM_BLOCK_BITS;
+                    long long r = 0;
+
+                    for (scm_block *b = q->bv + q->lv[l].b; k; k--, b++)
+                    {
+                        b->r = (uint64_t) r;
+
+                        for (int w = 0; w < 7; w++)
+                            r += popcount(b->w[w]);
+                    }
+                }
+        }
+        else return false;
+    }
+    return true;
+}
+
+// Release the bit vectors of occupancy index q.
+
+void scm_occ_free(scm_occ *q)
+{
+    free(q->bv);
+    memset(q, 0, sizeof (scm_occ));
+}
+
+//------------------------------------------------------------------------------
+
+// Return the position of page x in the sorted index array of occupancy index q,
+// or -1 if page x is not present. Dense levels answer with a single bit test
+// and a rank within one cache line.
+
+long long scm_occ_search(const scm_occ *q, long long x)
+{
+    long long l;
+
+    if (x < 0 || (l = scm_page_level(x)) >= q->lc || q->lv[l].n == 0)
+        return -1;
+
+    if (q->lv[l].b >= 0)
+    {
+        int              k;
+        const scm_block *b = locate(q, x, l, &k);
+        const uint64_t   m = 1ULL << (k % 64);
+        const int        w = k / 64;
+
+        if (b->w[w] & m)
+        {
+            long long r = (long long) b->r + popcount(b->w[w] & (m - 1));
+
+            for (int u = 0; u < w; u++)
+                r += popcount(b->w[u]);
+
+            return q->lv[l].i + r;
+        }
+        return -1;
+    }
+    else
+    {
+        long long i = q->lv[l].i;
+        long long j = q->lv[l].i + q->lv[l].n;
+
+        while (i < j)
+        {
+            long long h = i + (j - i) / 2;
+
+            if      (q->xv[h] < x) i = h + 1;
+            else if (q->xv[h] > x) j = h;
+            else return h;
+        }
+        return -1;
+    }
+}
+
+// Page x is a leaf if none of its children are present.
+
+bool scm_occ_leaf(const scm_occ *q, long long x)
+{
+    long long v[4];
+
+    scm_page_children(x, v);
+
+    if      (scm_occ_search(q, v[0]) >= 0) return false;
+    else if (scm_occ_search(q, v[1]) >= 0) return false;
+    else if (scm_occ_search(q, v[2]) >= 0) return false;
+    else if (scm_occ_search(q, v[3]) >= 0) return false;
+
+    else return true;
+}
+
+//------------------------------------------------------------------------------
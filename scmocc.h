@@ -0,0 +1,29 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef SCMTIFF_SCMOCC_H
+#define SCMTIFF_SCMOCC_H
+
+#include <stdbool.h>
+#include "scmdat.h"
+
+//------------------------------------------------------------------------------
+
+bool      scm_occ_init  (scm_occ *, long long, const long long *);
+void      scm_occ_free  (scm_occ *);
+
+long long scm_occ_search(const scm_occ *, long long);
+bool      scm_occ_leaf  (const scm_occ *, long long);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -11,10 +11,12 @@
 // more details.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
 #include "scm.h"
+#include "img.h"
 #include "err.h"
 #include "process.h"
 
@@ -51,18 +53,31 @@ int main(int argc, char **argv)
     const char *p    = NULL;
     const char *m    = NULL;
     const char *o    = NULL;
+    const char *S    = NULL;
+    const char *Q    = NULL;
     const char *t    = NULL;
+    const char *z    = NULL;
     int         n    = 512;
     int         d    =   0;
+    int         D    =   0;
     int         b    =  -1;
     int         g    =  -1;
     int         A    =   0;
+    int         F    =   0;
     int         h    =   0;
     int         l    =   0;
     int         T    =   0;
+    int         M    =   0;
+    int         J    =   0;
+    int         Z    =   0;
+    double      a    = 0.0;
+    int         u    =   0;
     double      E[4] = { 0.f, 0.f, 0.f , 0.f};
-    double      L[3] = { 0.f, 0.f, 0.f };
-    double      P[3] = { 0.f, 0.f, 0.f };
+    double      B[4] = { 0.f, 0.f, 0.f , 0.f};
+    double     *L    = (double *) calloc((size_t) argc * 3, sizeof (double));
+    double     *P    = (double *) calloc((size_t) argc * 3, sizeof (double));
+    int         Lc   =   0;
+    int         Pc   =   0;
     float       N[2] = { 0.f, 0.f };
     float       R[2] = { 0.f, 1.f };
 
@@ -73,32 +88,55 @@ int main(int argc, char **argv)
 
     setexe(exe);
 
+    if (L == NULL || P == NULL)
+        return -1;
+
     opterr = 0;
 
-    while ((c = getopt(argc, argv, "Ab:d:E:g:hL:l:m:n:N:o:p:P:Tt:R:w:")) != -1)
+    while ((c = getopt(argc, argv, "Aa:B:b:d:E:Fg:hj:L:l:M:m:n:N:o:p:P:Q:rS:s:Tt:R:w:z:")) != -1)
         switch (c)
         {
             case 'A': A = 1;                    break;
+            case 'F': F = 1;                    break;
             case 'h': h = 1;                    break;
             case 'T': T = 1;                    break;
+            case 'r': u = 1;                    break;
             case 'p': p = optarg;               break;
             case 'm': m = optarg;               break;
             case 'o': o = optarg;               break;
+            case 'S': S = optarg;               break;
+            case 'Q': Q = optarg;               break;
             case 't': t = optarg;               break;
+            case 'z': z = optarg;               break;
             case 'n': sscanf(optarg, "%d", &n); break;
-            case 'd': sscanf(optarg, "%d", &d); break;
+            case 'd':
+                if (sscanf(optarg, "%d,%d", &D, &d) < 2) d = D;
+                break;
             case 'b': sscanf(optarg, "%d", &b); break;
             case 'g': sscanf(optarg, "%d", &g); break;
             case 'l': sscanf(optarg, "%d", &l); break;
+            case 'M': sscanf(optarg, "%d", &M); break;
+            case 'j': sscanf(optarg, "%d", &J); break;
+            case 's': sscanf(optarg, "%d", &Z); break;
+            case 'a': sscanf(optarg, "%lf", &a); break;
 
             case 'E':
                 sscanf(optarg, "%lf,%lf,%lf,%lf", E + 0, E + 1, E + 2, E + 3);
                 break;
+            case 'B':
+                sscanf(optarg, "%lf,%lf,%lf,%lf", B + 0, B + 1, B + 2, B + 3);
+                break;
             case 'L':
-                sscanf(optarg, "%lf,%lf,%lf",     L + 0, L + 1, L + 2);
+                if (Lc < argc) sscanf(optarg, "%lf,%lf,%lf", L + 3 * Lc + 0,
+                                                             L + 3 * Lc + 1,
+                                                             L + 3 * Lc + 2);
+                Lc++;
                 break;
             case 'P':
-                sscanf(optarg, "%lf,%lf,%lf",     P + 0, P + 1, P + 2);
+                if (Pc < argc) sscanf(optarg, "%lf,%lf,%lf", P + 3 * Pc + 0,
+                                                             P + 3 * Pc + 1,
+                                                             P + 3 * Pc + 2);
+                Pc++;
                 break;
             case 'N':
                 sscanf(optarg, "%f,%f",           N + 0, N + 1);
@@ -113,22 +151,60 @@ int main(int argc, char **argv)
     argc -= optind;
     argv += optind;
 
+    // A single blend range applies to all inputs. Several apply in order.
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (Lc == 1) memcpy(L + 3 * i, L, 3 * sizeof (double));
+        if (Pc == 1) memcpy(P + 3 * i, P, 3 * sizeof (double));
+    }
+
+    if (z)
+    {
+        if      (strcmp(z, "size")  == 0) scm_set_codec(SCM_CODEC_SIZE);
+        else if (strcmp(z, "speed") == 0) scm_set_codec(SCM_CODEC_SPEED);
+        else apperr("Unknown codec policy '%s'", z);
+    }
+
+    if (M > 0)
+        img_set_budget((size_t) M << 20);
+    if (Z > 0)
+        img_set_stage((size_t) Z << 20);
+    if (a > 0)
+        img_set_approx(a);
+
     if (p == NULL || h)
         apperr("\nUsage: %s [options] input [...]\n"
                 "\t\t-p process . . Select process\n"
                 "\t\t-o output  . . Output file\n"
-                "\t\t-T . . . . . . Emit timing information\n\n"
+                "\t\t-T . . . . . . Emit timing information\n"
+                "\t\t-r . . . . . . Resume an interrupted convert, mipmap, or border\n"
+                "\t\t-z size  . . . Choose page codecs for size\n"
+                "\t\t-z speed . . . Choose page codecs for decode speed\n"
+                "\t\t-M m . . . . . Page input images over m MB to disk\n"
+                "\t\t-s m . . . . . Stage up to m MB of normalized input\n"
+                "\t\t-a e . . . . . Approximate projections within e pixels\n\n"
                 "\t%s -p extrema\n\n"
                 "\t%s -p convert [options]\n"
                 "\t\t-n n . . . . . Page size\n"
                 "\t\t-d d . . . . . Tree depth\n"
+                "\t\t-d d0,d1 . . . Write all levels d0 through d1\n"
                 "\t\t-b b . . . . . Channel depth override\n"
                 "\t\t-g g . . . . . Channel sign override\n"
                 "\t\t-E w,e,s,n . . Equirectangular range\n"
+                "\t\t-B w,e,s,n . . Limit output to a region of interest\n"
+                "\t\t-Q file  . . . Limit output to a lat-lon polygon, longitude continuous\n"
                 "\t\t-L c,d0,d1 . . Longitude blend range\n"
                 "\t\t-P c,d0,d1 . . Latitude blend range\n"
                 "\t\t-N n0,n1 . . . Normalization range\n"
-                "\t\t-A . . . . . . Coverage alpha\n\n"
+                "\t\t-A . . . . . . Coverage alpha\n"
+                "\t\t-F . . . . . . Filter through an input image pyramid\n"
+                "\t\t-S 1 . . . . . Sample with one tap per pixel\n"
+                "\t\t-S 5 . . . . . Sample with a quincunx (default)\n"
+                "\t\t-S NxN . . . . Sample with an N-by-N tent-weighted grid\n"
+                "\t\t-S s,t,w,... . Sample with the given taps and weights\n"
+                "\t\t-j n . . . . . Convert up to n inputs concurrently\n"
+                "\t\t-m mode  . . . Mosaic all inputs using combine mode\n\n"
                 "\t%s -p combine [-m mode]\n"
                 "\t\t-m sum . . . . Combine by sum\n"
                 "\t\t-m max . . . . Combine by maximum\n"
@@ -139,19 +215,28 @@ int main(int argc, char **argv)
                 "\t\t-m max . . . . Combine by maximum\n"
                 "\t\t-m avg . . . . Combine by average\n\n"
                 "\t%s -p border\n\n"
+                "\t%s -p collect\n\n"
                 "\t%s -p finish [options]\n"
                 "\t\t-t text  . . . Image description text file\n"
                 "\t\t-l l . . . . . Bounding volume oversample level\n\n"
+                "\t%s -p reorder [options]\n"
+                "\t\t-m index . . . Order pages by index\n"
+                "\t\t-m z . . . . . Order pages by Z-order within each level\n"
+                "\t\t-t text  . . . Image description text file\n"
+                "\t\t-l l . . . . . Bounding volume oversample level\n\n"
                 "\t%s -p normal [options]\n"
+                "\t\t-R r0,r1 . . . Radius range\n\n"
+                "\t%s -p visible [options] < views\n"
                 "\t\t-R r0,r1 . . . Radius range\n",
 
-                exe, exe, exe, exe, exe, exe, exe, exe);
+                exe, exe, exe, exe, exe, exe, exe, exe, exe, exe, exe);
 
     else if (strcmp(p, "extrema") == 0)
         r = extrema(argc, argv);
 
     else if (strcmp(p, "convert") == 0)
-        r = convert(argc, argv, o, n, d, b, g, A, N, E, L, P);
+        r = convert(argc, argv, o, m, S, Q, n, d, D, b, g, A, F, u, J,
+                                                  N, E, B, L, P);
 
     else if (strcmp(p, "rectify") == 0)
         r = rectify(argc, argv, o, n,             N, E, L, P);
@@ -160,14 +245,20 @@ int main(int argc, char **argv)
         r = combine(argc, argv, o, m);
 
     else if (strcmp(p, "mipmap") == 0)
-        r = mipmap (argc, argv, o, m, A);
+        r = mipmap (argc, argv, o, m, A, u);
 
     else if (strcmp(p, "border") == 0)
-        r = border (argc, argv, o);
+        r = border (argc, argv, o, u);
+
+    else if (strcmp(p, "collect") == 0)
+        r = collect(argc, argv, o);
 
     else if (strcmp(p, "finish") == 0)
         r = finish (argc, argv, t, l);
 
+    else if (strcmp(p, "reorder") == 0)
+        r = reorder(argc, argv, o, m, t, l);
+
     else if (strcmp(p, "polish") == 0)
         r = polish (argc, argv);
 
@@ -177,11 +268,17 @@ int main(int argc, char **argv)
     else if (strcmp(p, "sample") == 0)
         r = sample (argc, argv, R, d);
 
+    else if (strcmp(p, "visible") == 0)
+        r = visible(argc, argv, R);
+
     else apperr("Unknown process '%s'", p);
 
     t1 = now();
 
     if (T) printhms(t1 - t0);
 
+    free(P);
+    free(L);
+
     return r;
 }
@@ -0,0 +1,409 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+#include "scmdef.h"
+#include "scmdat.h"
+#include "scmio.h"
+#include "scmocc.h"
+#include "scm.h"
+#include "err.h"
+#include "util.h"
+
+//------------------------------------------------------------------------------
+
+// Release the finished catalog of SCM s.
+
+static void scm_drop_bounds(scm *s)
+{
+    scm_occ_free(&s->yq);
+
+    free(s->yv);
+    free(s->av);
+    free(s->zv);
+    free(s->rv);
+
+    s->yc = 0;
+    s->rc = 0;
+    s->yv = NULL;
+    s->av = NULL;
+    s->zv = NULL;
+    s->rv = NULL;
+}
+
+// Read the finished catalog of single SCM s: the page index, minimum, and
+// maximum fields of its header, with bounds converted to float.
+
+static bool scm_load_bounds(scm *s)
+{
+    const size_t sz = tifsizeof(scm_type(s));
+
+    header h;
+    hfd    d;
+
+    void *ab = NULL;
+    void *zb = NULL;
+
+    bool st = false;
+
+    if (scm_read_header(s, &h) && scm_read_hfd(s, &d, h.first_ifd))
+    {
+        const long long c = (long long) d.page_index.count;
+        const size_t    n = (size_t) c * (size_t) s->c;
+
+        if (c && d.page_minimum.count == n && d.page_maximum.count == n)
+        {
+            if ((s->yv = (long long *) malloc((size_t) c * sizeof (long long))) &&
+                (s->av = (float     *) malloc(n * sizeof (float))) &&
+                (s->zv = (float     *) malloc(n * sizeof (float))) &&
+                (ab    =                 malloc(n * sz)) &&
+                (zb    =                 malloc(n * sz)))
+            {
+                if (scm_read(s, s->yv, (size_t) c * sizeof (long long),
+                                        (long long) d.page_index.offset) &&
+                    scm_read(s, ab, n * sz, (long long) d.page_minimum.offset) &&
+                    scm_read(s, zb, n * sz, (long long) d.page_maximum.offset))
+                {
+                    btof(ab, s->av, n, s->b, s->g);
+                    btof(zb, s->zv, n, s->b, s->g);
+
+                    s->yc = c;
+                    st    = true;
+                }
+            }
+        }
+        else apperr("%s: SCM TIFF is not finished", s->name);
+    }
+    free(zb);
+    free(ab);
+
+    if (!st)
+        scm_drop_bounds(s);
+
+    return st;
+}
+
+// Standard-library-compatible compare function for bound pairs.
+
+static int bpcompare(const void *p, const void *q)
+{
+    const scm_pair *a = (const scm_pair *) p;
+    const scm_pair *b = (const scm_pair *) q;
+
+    if      (a->x < b->x) return -1;
+    else if (a->x > b->x) return +1;
+    else if (a->o < b->o) return -1;
+    else if (a->o > b->o) return +1;
+    else                  return  0;
+}
+
+// Merge the finished catalogs of all shards of collection s. A page finished
+// by more than one shard takes the union of its bounds.
+
+static bool scm_merge_bounds(scm *s)
+{
+    const long long m = (1LL << SCM_SHARD_SHIFT) - 1;
+
+    scm_pair *v = NULL;
+
+    long long c = 0;
+    long long i;
+    long long j;
+    int       k;
+
+    for (k = 0; k < s->sc; k++)
+        if (scm_load_bounds(s->sv[k]))
+            c += s->sv[k]->yc;
+        else
+            break;
+
+    if (k == s->sc && (v = (scm_pair *) malloc((size_t) c * sizeof (scm_pair))))
+    {
+        for (c = 0, k = 0; k < s->sc; k++)
+            for (i = 0; i < s->sv[k]->yc; i++, c++)
+            {
+                v[c].x = s->sv[k]->yv[i];
+                v[c].o = ((long long) k << SCM_SHARD_SHIFT) | i;
+            }
+
+        qsort(v, (size_t) c, sizeof (scm_pair), bpcompare);
+
+        if ((s->yv = (long long *) malloc((size_t) c * sizeof (long long))) &&
+            (s->av = (float     *) malloc((size_t) c * s->c * sizeof (float))) &&
+            (s->zv = (float     *) malloc((size_t) c * s->c * sizeof (float))))
+        {
+            for (j = -1, i = 0; i < c; i++)
+            {
+                const scm *t = s->sv[v[i].o >> SCM_SHARD_SHIFT];
+                const long long p = v[i].o & m;
+
+                if (j < 0 || s->yv[j] != v[i].x)
+                {
+                    j++;
+                    s->yv[j] = v[i].x;
+
+                    for (int e = 0; e < s->c; e++)
+                    {
+                        s->av[j * s->c + e] =  FLT_MAX;
+                        s->zv[j * s->c + e] = -FLT_MAX;
+                    }
+                }
+                for (int e = 0; e < s->c; e++)
+                {
+                    if (s->av[j * s->c + e] > t->av[p * s->c + e])
+                        s->av[j * s->c + e] = t->av[p * s->c + e];
+                    if (s->zv[j * s->c + e] < t->zv[p * s->c + e])
+                        s->zv[j * s->c + e] = t->zv[p * s->c + e];
+                }
+            }
+            s->yc = j + 1;
+        }
+    }
+    free(v);
+
+    for (k = 0; k < s->sc; k++)
+        scm_drop_bounds(s->sv[k]);
+
+    if (s->yc == 0)
+    {
+        scm_drop_bounds(s);
+        return false;
+    }
+    return true;
+}
+
+// Read the finished catalog of SCM s, giving the index and bounds of all pages
+// real and virtual, and index its occupancy for traversal. Traversal begins at
+// each page whose parent is absent, which for a mipmapped file are the roots.
+
+bool scm_scan_bounds(scm *s)
+{
+    assert(s);
+
+    scm_drop_bounds(s);
+
+    if (s->sv ? scm_merge_bounds(s) : scm_load_bounds(s))
+    {
+        if (scm_occ_init(&s->yq, s->yc, s->yv))
+        {
+            long long i;
+
+            for (i = 0; i < s->yc; i++)
+                if (s->yv[i] < 6 || scm_occ_search(&s->yq,
+                                    scm_page_parent(s->yv[i])) < 0)
+                    s->rc++;
+
+            if ((s->rv = (long long *) malloc((size_t) s->rc
+                                                * sizeof (long long))))
+            {
+                for (s->rc = 0, i = 0; i < s->yc; i++)
+                    if (s->yv[i] < 6 || scm_occ_search(&s->yq,
+                                        scm_page_parent(s->yv[i])) < 0)
+                        s->rv[s->rc++] = s->yv[i];
+
+                return true;
+            }
+        }
+        scm_drop_bounds(s);
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+static inline double dot3(const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Determine the hull of page x, given its radius range a through z. The four
+// corner directions at radius a form the inner face, and their intersections
+// with the plane tangent to radius z above the page center form the outer.
+// Page edges are great circles, so these eight points bound the page.
+
+static void scm_page_hull(long long x, double a, double z, double *v)
+{
+    double c[12];
+    double m[3];
+
+    scm_page_corners(x, c);
+
+    m[0] = c[0] + c[3] + c[6] + c[9];
+    m[1] = c[1] + c[4] + c[7] + c[10];
+    m[2] = c[2] + c[5] + c[8] + c[11];
+
+    normalize(m);
+
+    for (int i = 0; i < 4; i++)
+    {
+        const double t = z / dot3(c + i * 3, m);
+
+        v[i * 3 +  0] = c[i * 3 + 0] * a;
+        v[i * 3 +  1] = c[i * 3 + 1] * a;
+        v[i * 3 +  2] = c[i * 3 + 2] * a;
+        v[i * 3 + 12] = c[i * 3 + 0] * t;
+        v[i * 3 + 13] = c[i * 3 + 1] * t;
+        v[i * 3 + 14] = c[i * 3 + 2] * t;
+    }
+}
+
+// Determine whether the hull v lies entirely outside any plane of view w.
+
+static bool scm_hull_culled(const scm_view *w, const double *v)
+{
+    for (int j = 0; j < w->pc; j++)
+    {
+        int i;
+
+        for (i = 0; i < 8; i++)
+            if (dot3(w->P[j], v + i * 3) + w->P[j][3] >= 0.0)
+                break;
+
+        if (i == 8)
+            return true;
+    }
+    return false;
+}
+
+// Visit page x of SCM s, noting it in p if it is visible within view w with
+// sufficient detail, or visiting its children if not. Return the new count.
+
+static long long scm_visit(scm *s, const scm_view *w, long long x,
+                                   long long *p, long long n, long long c)
+{
+    long long i;
+
+    if ((i = scm_occ_search(&s->yq, x)) >= 0)
+    {
+        const double a = w->r0 + (w->r1 - w->r0) * s->av[i * s->c];
+        const double z = w->r0 + (w->r1 - w->r0) * s->zv[i * s->c];
+
+        double v[24];
+        double o[3] = { 0.0, 0.0, 0.0 };
+        double r    = 0.0;
+        double d[3];
+
+        if (a > z)
+            return c;
+
+        scm_page_hull(x, a, z, v);
+
+        if (scm_hull_culled(w, v))
+            return c;
+
+        // Find a bounding sphere of the hull and its distance from the eye.
+
+        for (int j = 0; j < 8; j++)
+        {
+            o[0] += v[j * 3 + 0] / 8.0;
+            o[1] += v[j * 3 + 1] / 8.0;
+            o[2] += v[j * 3 + 2] / 8.0;
+        }
+        for (int j = 0; j < 8; j++)
+        {
+            d[0] = v[j * 3 + 0] - o[0];
+            d[1] = v[j * 3 + 1] - o[1];
+            d[2] = v[j * 3 + 2] - o[2];
+
+            if (r < dot3(d, d))
+                r = dot3(d, d);
+        }
+        r = sqrt(r);
+
+        d[0] = o[0] - w->E[0];
+        d[1] = o[1] - w->E[1];
+        d[2] = o[2] - w->E[2];
+
+        const double e = sqrt(dot3(d, d));
+
+        // Cull the sphere against the view cone.
+
+        if (w->a > 0.0 && e > r)
+        {
+            const double t = acos(max(-1.0, min(1.0, dot3(d, w->A) / e)));
+
+            if (t - asin(r / e) > w->a)
+                return c;
+        }
+
+        // Estimate the screen-space size of a sample of this page, taking
+        // the diagonal arc at the top of its radius range.
+
+        const double q = dot3(v + 12, v + 21) / sqrt(dot3(v + 12, v + 12) *
+                                                     dot3(v + 21, v + 21));
+        const double g = acos(min(1.0, q));
+        const double k = w->k * z * g / s->n / max(e - r, DBL_EPSILON * z);
+
+        // Refine if the error is too large and all children are present as
+        // real pages. Virtual pages have bounds but no data to read.
+
+        if (k > w->e)
+        {
+            long long xv[4];
+
+            scm_page_children(x, xv);
+
+            const long long x0 = xv[0];
+            const long long x1 = xv[1];
+            const long long x2 = xv[2];
+            const long long x3 = xv[3];
+
+            if (scm_search(s, x0) >= 0 &&
+                scm_search(s, x1) >= 0 &&
+                scm_search(s, x2) >= 0 &&
+                scm_search(s, x3) >= 0)
+            {
+                c = scm_visit(s, w, x0, p, n, c);
+                c = scm_visit(s, w, x1, p, n, c);
+                c = scm_visit(s, w, x2, p, n, c);
+                c = scm_visit(s, w, x3, p, n, c);
+                return c;
+            }
+        }
+
+        if (c < n)
+            p[c] = x;
+
+        c++;
+    }
+    return c;
+}
+
+// Determine the set of pages of SCM s visible within view w, each at a level
+// of detail meeting the view's screen-space error target. Note up to n page
+// indices in p and return the total count, which may exceed n. Every page
+// noted is a real page. Both the page catalog and the finished catalog must
+// have been read, using scm_scan_catalog and scm_scan_bounds.
+
+long long scm_visible(scm *s, const scm_view *w, long long *p, long long n)
+{
+    long long c = 0;
+
+    assert(s);
+    assert(w);
+    assert(s->yv);
+    assert(s->xv);
+
+    for (long long i = 0; i < s->rc; i++)
+        if (scm_search(s, s->rv[i]) >= 0)
+            c = scm_visit(s, w, s->rv[i], p, n, c);
+
+    return c;
+}
+
+//------------------------------------------------------------------------------
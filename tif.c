@@ -12,14 +12,163 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <tiffio.h>
 
 #include "img.h"
 #include "err.h"
+#include "util.h"
 
 //------------------------------------------------------------------------------
 
-img *tif_load(const char *name)
+// Decode tiles of directory D of the named TIFF into image p. Each thread opens
+// its own TIFF handle and decodes tiles from a shared list, copying each to its
+// position in the image. Return false if any handle or tile fails.
+
+static bool load_tiles(img *p, const char *name, tdir_t D, uint32 tw,
+                                                           uint32 th)
+{
+    const size_t s = (size_t) p->c * (size_t) p->b / 8;
+    const int    m = (int) ((p->w + tw - 1) / tw);
+    const int    n = (int) ((p->h + th - 1) / th) * m;
+
+    bool r = true;
+
+    #pragma omp parallel reduction(&&:r)
+    {
+        TIFF *T = TIFFOpen(name, "r");
+        char *b = NULL;
+        int   k;
+
+        if (T && TIFFSetDirectory(T, D))
+            b = (char *) malloc((size_t) TIFFTileSize(T));
+
+        // Every thread reaches the loop, skipping all work if it failed.
+
+        #pragma omp for schedule(dynamic)
+        for (k = 0; k < n; k++)
+        {
+            const int i0 = (k / m) * (int) th;
+            const int j0 = (k % m) * (int) tw;
+            const int i1 = min(i0 + (int) th, p->h);
+            const int j1 = min(j0 + (int) tw, p->w);
+
+            if (b && TIFFReadEncodedTile(T, (ttile_t) k, b, (tmsize_t) -1) > 0)
+
+                for (int i = i0; i < i1; i++)
+                    memcpy((char *) img_scanline(p, i) + s * j0,
+                           b + s * tw * (i - i0), s * (j1 - j0));
+            else
+                r = false;
+        }
+
+        if (b == NULL) r = false;
+
+        free(b);
+        if (T) TIFFClose(T);
+    }
+    return r;
+}
+
+// Decode strips of directory D of the named TIFF into image p. Strips are
+// contiguous in the image, so each thread decodes directly to the image buffer
+// using its own TIFF handle. Return false if any handle or strip fails.
+
+static bool load_strips(img *p, const char *name, tdir_t D, uint32 rs)
+{
+    const size_t s = (size_t) p->w * (size_t) p->c * (size_t) p->b / 8;
+    const int    n = (int) ((p->h + rs - 1) / rs);
+
+    bool r = true;
+
+    #pragma omp parallel reduction(&&:r)
+    {
+        TIFF *T = TIFFOpen(name, "r");
+        bool  d = (T && TIFFSetDirectory(T, D));
+        int   k;
+
+        // Every thread reaches the loop, skipping all work if it failed.
+
+        #pragma omp for schedule(dynamic)
+        for (k = 0; k < n; k++)
+        {
+            const int i0 = k * (int) rs;
+            const int i1 = min(i0 + (int) rs, p->h);
+
+            void *q = img_scanline(p, i0);
+
+            if (!d || TIFFReadEncodedStrip(T, (tstrip_t) k, q,
+                                           (tmsize_t) (s * (i1 - i0))) < 0)
+                r = false;
+        }
+
+        if (!d) r = false;
+
+        if (T) TIFFClose(T);
+    }
+    return r;
+}
+
+// Load the current directory of TIFF T, the named file, if its size is w by h
+// and its format is c channels of b bits with sign g. Negative values accept
+// any. Return the image, or NULL if the directory does not match or any part
+// of it fails to decode.
+
+static img *load_dir(TIFF *T, const char *name, int w, int h,
+                                                int c, int b, int g)
+{
+    img *p = NULL;
+
+    uint32 W, H, TW, TH, RS;
+    uint16 B, C, S, P;
+
+    TIFFGetField         (T, TIFFTAG_IMAGEWIDTH,      &W);
+    TIFFGetField         (T, TIFFTAG_IMAGELENGTH,     &H);
+    TIFFGetFieldDefaulted(T, TIFFTAG_BITSPERSAMPLE,   &B);
+    TIFFGetFieldDefaulted(T, TIFFTAG_SAMPLESPERPIXEL, &C);
+    TIFFGetFieldDefaulted(T, TIFFTAG_SAMPLEFORMAT,    &S);
+    TIFFGetFieldDefaulted(T, TIFFTAG_PLANARCONFIG,    &P);
+    TIFFGetFieldDefaulted(T, TIFFTAG_ROWSPERSTRIP,    &RS);
+
+    if ((w < 0 || w == (int) W) && (c < 0 || c == (int) C) &&
+        (h < 0 || h == (int) H) && (b < 0 || b == (int) B) &&
+                                   (g < 0 || g == (S == 2)))
+    {
+        if (P == PLANARCONFIG_CONTIG || C == 1)
+        {
+            if ((p = img_alloc((int) W, (int) H, (int) C, (int) B, (S == 2))))
+            {
+                bool r;
+
+                if (TIFFIsTiled(T))
+                {
+                    TIFFGetField(T, TIFFTAG_TILEWIDTH,  &TW);
+                    TIFFGetField(T, TIFFTAG_TILELENGTH, &TH);
+
+                    r = load_tiles(p, name, TIFFCurrentDirectory(T), TW, TH);
+                }
+                else
+                    r = load_strips(p, name, TIFFCurrentDirectory(T),
+                                                           min(RS, H));
+
+                if (!r)
+                {
+                    apperr("%s: failed to decode image data", name);
+                    img_close(p);
+                    p = NULL;
+                }
+            }
+        }
+        else apperr("%s: separate planes not supported", name);
+    }
+    return p;
+}
+
+// Load the named TIFF. If m is set, following reduced-resolution directories
+// that halve the size of the image, such as overviews, give the levels of the
+// image pyramid.
+
+img *tif_load(const char *name, int m)
 {
     img  *p = NULL;
     TIFF *T = NULL;
@@ -28,20 +177,19 @@ img *tif_load(const char *name)
 
     if ((T = TIFFOpen(name, "r")))
     {
-        uint32 W, H;
-        uint16 B, C, S;
-
-        TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &W);
-        TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &H);
-        TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &B);
-        TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &C);
-        TIFFGetField(T, TIFFTAG_SAMPLEFORMAT,    &S);
+        if ((p = load_dir(T, name, -1, -1, -1, -1, -1)))
+        {
+            uint32 F;
+            img   *q;
 
-        if ((p = img_alloc((int) W, (int) H, (int) C, (int) B, (S == 2))))
+            for (q = p; m && q && TIFFReadDirectory(T); q = q->mip)
 
-            for (uint32 i = 0; i < H; ++i)
-                TIFFReadScanline(T, img_scanline(p, (int) i), i, 0);
+                if (TIFFGetField(T, TIFFTAG_SUBFILETYPE, &F) &&
+                                          (F & FILETYPE_REDUCEDIMAGE))
 
+                    q->mip = load_dir(T, name, (q->w + 1) / 2,
+                                               (q->h + 1) / 2, q->c, q->b, q->g);
+        }
         TIFFClose(T);
     }
     return p;
@@ -10,11 +10,14 @@
 // FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
 // more details.
 
+#include <stdlib.h>
+#include <stdio.h>
 #include <math.h>
 #include <string.h>
 
 #include "config.h"
 #include "util.h"
+#include "err.h"
 
 //------------------------------------------------------------------------------
 
@@ -154,4 +157,113 @@ int grow(float *p, float *q, int c, int n)
         }
     return N;
 }
+
+//------------------------------------------------------------------------------
+
+static inline float sum(float a, float b)
+{
+    return a + b;
+}
+
+static inline float avg(float a, float b)
+{
+    if (a == 0.f) return b;
+    if (b == 0.f) return a;
+    return (a + b) * 0.5f;
+}
+
+static inline void blend(float *dst, const float *src, int c)
+{
+    const float a =       src[c - 1];
+    const float b = 1.f - src[c - 1];
+
+    switch (c)
+    {
+        case 4: dst[2] = dst[2] * b + src[2] * a;
+        case 3: dst[1] = dst[1] * b + src[1] * a;
+        case 2: dst[0] = dst[0] * b + src[0] * a;
+    }
+    dst[c - 1] = max(dst[c - 1], src[c - 1]);
+}
+
+// Return the page combination mode named by m: sum, max, avg, or blend.
+
+int combine_mode(const char *m)
+{
+    if      (strcmp(m, "sum")   == 0) return 0;
+    else if (strcmp(m, "max")   == 0) return 1;
+    else if (strcmp(m, "avg")   == 0) return 2;
+    else if (strcmp(m, "blend") == 0) return 3;
+    else                              return 0;
+}
+
+// Combine page buffer q into page buffer p, each having size n and c channels,
+// using combination mode O.
+
+void combine_page(float *p, const float *q, int c, int n, int O)
+{
+    const size_t S = (size_t) (n + 2) * (size_t) (n + 2) * (size_t) c;
+
+    switch (O)
+    {
+        case 0:
+            for (size_t j = 0; j < S; ++j)
+                p[j] = sum(p[j], q[j]);
+            break;
+        case 1:
+            for (size_t j = 0; j < S; ++j)
+                p[j] = max(p[j], q[j]);
+            break;
+        case 2:
+            for (size_t j = 0; j < S; ++j)
+                p[j] = avg(p[j], q[j]);
+            break;
+        case 3:
+            for (size_t j = 0; j < S; j += c)
+                blend(p + j, q + j, c);
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+char *load_txt(const char *name)
+{
+    // Load the named file into a newly-allocated buffer.
+
+    FILE *fp = 0;
+    void  *p = 0;
+    size_t n = 0;
+
+    if ((fp = fopen(name, "rb")))
+    {
+        if (fseek(fp, 0, SEEK_END) == 0)
+        {
+            if ((n = (size_t) ftell(fp)))
+            {
+                if (fseek(fp, 0, SEEK_SET) == 0)
+                {
+                    if ((p = calloc(n + 1, 1)))
+                    {
+                        if (fread(p, 1, n, fp) == n)
+                        {
+                            // The top of the mountain.
+                        }
+                        else apperr("Failure to read %s", name);
+                    }
+                    else apperr("Failure to allocate %s", name);
+                }
+                else apperr("Failed to seek %s", name);
+            }
+            else apperr("Failed to tell %s", name);
+        }
+        else apperr("Failed to seek %s", name);
+    }
+    else apperr("Failed to open %s", name);
+
+    fclose(fp);
+
+    return (char *) p;
+}
+
 //------------------------------------------------------------------------------
@@ -34,6 +34,11 @@ void dircpy(      char *, const char *);
 
 int grow(float *, float *, int, int);
 
+int  combine_mode(const char *);
+void combine_page(float *, const float *, int, int, int);
+
+char *load_txt(const char *);
+
 //------------------------------------------------------------------------------
 
 #endif
@@ -0,0 +1,91 @@
+// SCMTIFF Copyright (C) 2012-2015 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "scm.h"
+#include "scmdef.h"
+#include "err.h"
+#include "util.h"
+#include "process.h"
+
+//------------------------------------------------------------------------------
+
+// Read views from standard input, one per line, giving the eye position, the
+// view direction, the field of view in degrees, the projection scale, and the
+// error target. For each, print the indices of the visible pages of SCM s,
+// reading each page to confirm that it may be served.
+
+static void process(scm *s, const float *R)
+{
+    const long long n = scm_get_length(s);
+
+    long long *v = (long long *) malloc((size_t) n * sizeof (long long));
+    float     *p = scm_alloc_buffer(s);
+
+    scm_view w;
+
+    if (v && p)
+    {
+        while (scanf("%lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                     w.E + 0, w.E + 1, w.E + 2,
+                     w.A + 0, w.A + 1, w.A + 2, &w.a, &w.k, &w.e) == 9)
+        {
+            long long c;
+            long long i;
+            long long j;
+
+            normalize(w.A);
+
+            w.pc = 0;
+            w.a  = w.a * M_PI / 360.0;
+            w.r0 = R[0];
+            w.r1 = R[1];
+
+            c = scm_visible(s, &w, v, n);
+
+            for (i = 0; i < c && i < n; i++)
+            {
+                if ((j = scm_search(s, v[i])) >= 0 &&
+                    scm_read_page(s, scm_get_offset(s, j), p))
+                    printf("%lld ", v[i]);
+                else
+                    apperr("Visible page %lld is not readable", v[i]);
+            }
+            printf("\n");
+        }
+    }
+    free(p);
+    free(v);
+}
+
+int visible(int argc, char **argv, const float *R)
+{
+    if (argc > 0)
+    {
+        scm *s;
+
+        if ((s = scm_ifile(argv[0])))
+        {
+            if (scm_scan_catalog(s) && scm_scan_bounds(s))
+                process(s, R);
+
+            scm_close(s);
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------